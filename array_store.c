@@ -0,0 +1,346 @@
+#include "array_store.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+static const line_id_t empty_state_text = EMPTY_STATE_LINE;
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_text_array(dynamic_array_t* a)
+{
+    init_segmented_array(&a->array, sizeof(cell_t));
+    a->used_size = 0;
+    a->last_version_used_size = 0;
+    a->keep_undone_rows = 0;
+}
+
+void init_do_array(do_array_t* a)
+{
+    init_segmented_array(&a->array, sizeof(do_cell_t));
+    segmented_array_grow(&a->array);
+    a->used_size = 0;
+    do_cell(a, 0)->begin = -1; // initial state is identified with keys -1,-1
+    do_cell(a, 0)->end = -1;
+}
+
+void attach_array_store(dynamic_array_t* text_array, do_array_t* do_array, char* cells, int64_t cell_count, char* slices, int64_t slice_count)
+{
+    init_text_array(text_array);
+    segmented_array_borrow(&text_array->array, cells, (cell_count + SEGMENT_SIZE - 1) >> SEGMENT_SHIFT);
+    init_segmented_array(&do_array->array, sizeof(do_cell_t));
+    segmented_array_borrow(&do_array->array, slices, (slice_count + SEGMENT_SIZE - 1) >> SEGMENT_SHIFT);
+    do_array->used_size = 0;
+}
+
+void array_insert_no_replace(dynamic_array_t *text_array, do_array_t *do_array, int64_t line_number, line_id_t effective_string)
+{
+    if (text_array->used_size == (int64_t)text_array->array.max_size)
+        segmented_array_grow(&text_array->array);
+    text_array->used_size++;
+    INSTR_ADD(lines_copied, 1);
+    text_array->last_version_used_size++; //used values increase only in this case, in the other cases it is just a replace
+    text_cell(text_array, line_number-1+ do_cell(do_array, do_array->used_size)->begin)->text_line = effective_string;
+}
+
+void array_insert_with_replace(dynamic_array_t *text_array, do_array_t *do_array, const line_id_t *lines, int64_t start, int64_t end)
+{
+    int64_t previous_state_begin = do_cell(do_array, do_array->used_size-1)->begin; // assignment with the beginning of the previous state, easier to read
+    int64_t line_number;
+    int64_t i;
+    line_id_t effective_string;
+
+    text_array->last_version_used_size = 0;
+    for (i = 0; i < (start-1); i++){ //copies values between i and start (i.e. 3,6c --> copy index 1-2)
+        if (text_array->used_size == (int64_t)text_array->array.max_size)
+            segmented_array_grow(&text_array->array);
+        text_cell(text_array, do_cell(do_array, do_array->used_size)->begin+i)->text_line = text_cell(text_array, previous_state_begin+i)->text_line;
+        text_array->used_size++;
+        INSTR_ADD(lines_copied, 1);
+        text_array->last_version_used_size++;
+    }
+
+    for (line_number = start; line_number <= end; line_number++){ // performs a substitution of already present values
+        effective_string = lines[line_number - start];
+
+        if (text_array->used_size == (int64_t)text_array->array.max_size)
+            segmented_array_grow(&text_array->array);
+
+        text_array->used_size++;
+        INSTR_ADD(lines_copied, 1);
+        text_array->last_version_used_size++; //used values increase only in this case, in the other cases it is just a replace
+        text_cell(text_array, line_number-1+ do_cell(do_array, do_array->used_size)->begin)->text_line = effective_string;
+    }
+
+    for (i = text_array->last_version_used_size + do_cell(do_array, do_array->used_size)->begin-1; i < do_cell(do_array, do_array->used_size)->end ; i++){
+        if (text_array->used_size == (int64_t)text_array->array.max_size)
+            segmented_array_grow(&text_array->array);
+        text_cell(text_array, do_cell(do_array, do_array->used_size)->begin + text_array->last_version_used_size)->text_line = text_cell(text_array, do_cell(do_array, do_array->used_size-1)->begin + text_array->last_version_used_size)->text_line;
+        text_array->used_size++;
+        INSTR_ADD(lines_copied, 1);
+        text_array->last_version_used_size++;
+    }
+}
+
+void do_array_insert_only_no_replace(do_array_t* a, int64_t start, int64_t end)
+{
+    if (a->used_size + 1 == (int64_t)a->array.max_size) //the new state is stored at used_size + 1
+        segmented_array_grow(&a->array);
+    a->used_size++;
+
+    if (a->used_size == 1){ //case when it's at the beginning
+        do_cell(a, a->used_size)->begin = 0;
+        if (start == end) //command such as "1,1c"
+            do_cell(a, a->used_size)->end = 0;
+        else //command such as "1,3c"
+            do_cell(a, a->used_size)->end = end - start;
+    } else {
+        do_cell(a, a->used_size)->begin = do_cell(a, a->used_size-1)->begin;
+        do_cell(a, a->used_size)->end =  do_cell(a, a->used_size-1)->end + end - start + 1;
+    }
+}
+
+void do_array_insert_with_replace(do_array_t* do_array, int64_t first_free_slot, int64_t end)
+{
+    if (do_array->used_size + 1 == (int64_t)do_array->array.max_size) //the new state is stored at used_size + 1
+        segmented_array_grow(&do_array->array);
+    do_array->used_size++;
+
+    /*there are mainly two cases:   1) simple replace
+                                    2) replace + extra rows */
+    int64_t size_of_previous_state = do_cell(do_array, do_array->used_size-1)->end - do_cell(do_array, do_array->used_size-1)->begin + 1;
+
+    if (end <= size_of_previous_state){ //case 1: replace
+        do_cell(do_array, do_array->used_size)->begin = first_free_slot;
+        do_cell(do_array, do_array->used_size)->end = first_free_slot - 1 + size_of_previous_state;
+    }
+    else{ //case 2: replace + new cells
+        do_cell(do_array, do_array->used_size)->begin = first_free_slot;
+        do_cell(do_array, do_array->used_size)->end = first_free_slot - 1 + end;
+    }
+}
+
+void array_delete (do_array_t* do_array, dynamic_array_t* text_array, int64_t start, int64_t end)
+{
+    int64_t previous_state_size = do_cell(do_array, do_array->used_size-1)->end - do_cell(do_array, do_array->used_size-1)->begin + 1;
+
+    if (previous_state_size == 1){ //cheks that the previous state is not the "initial state" or the "empty state"
+        if (text_array->used_size == (int64_t)text_array->array.max_size)
+            segmented_array_grow(&text_array->array);
+        if (do_cell(do_array, do_array->used_size-1)->begin == -1 || text_cell(text_array, do_cell(do_array, do_array->used_size-1)->begin)->text_line == empty_state_text){ //the initial state has no cell in the text array
+            text_cell(text_array, do_cell(do_array, do_array->used_size)->begin)->text_line = empty_state_text;
+            text_array->used_size++;
+            INSTR_ADD(lines_copied, 1);
+            text_array->last_version_used_size = 1;
+            return;
+        }
+    }
+
+    int64_t i;
+    if (end < 1 || start >text_array->last_version_used_size){ //there are no deletions: it is a sort of empty command. In practice copies eventual values in the previous state
+        text_array->last_version_used_size = 0;
+        int64_t lines_to_be_copied = do_cell(do_array, do_array->used_size)->end - do_cell(do_array, do_array->used_size)->begin + 1;
+        for (i = 0; i < lines_to_be_copied; i++) { //copies the eventual values before the nodes that have to be deleted
+            if (text_array->used_size == (int64_t)text_array->array.max_size)
+                segmented_array_grow(&text_array->array);
+            text_cell(text_array, do_cell(do_array, do_array->used_size)->begin+i)->text_line = text_cell(text_array, do_cell(do_array, do_array->used_size-1)->begin+i)->text_line; //copies eventual values present in the previous state
+            text_array->used_size++;
+            INSTR_ADD(lines_copied, 1);
+            text_array->last_version_used_size++;
+        }
+    }else{
+        text_array->last_version_used_size = 0;
+
+        int64_t start_delete = max (1,start);
+        int64_t end_delete = min (end, previous_state_size);
+
+        if (start_delete == 1 && end_delete == previous_state_size){
+            if (text_array->used_size == (int64_t)text_array->array.max_size)
+                segmented_array_grow(&text_array->array);
+            text_cell(text_array, do_cell(do_array, do_array->used_size)->begin)->text_line = empty_state_text;
+            text_array->used_size++;
+            INSTR_ADD(lines_copied, 1);
+            text_array->last_version_used_size = 1;
+            return;
+        }
+
+        for (i = 0; i < start-1; i++) { //copies the eventual values before the nodes that have to be deleted
+            if (text_array->used_size == (int64_t)text_array->array.max_size)
+                segmented_array_grow(&text_array->array);
+            text_cell(text_array, do_cell(do_array, do_array->used_size)->begin+i)->text_line = text_cell(text_array, do_cell(do_array, do_array->used_size-1)->begin +i)->text_line; //copies eventual values present in the previous state
+            text_array->used_size++;
+            INSTR_ADD(lines_copied, 1);
+            text_array->last_version_used_size++;
+        }
+
+        for (i = 0; i < previous_state_size - end; i++){
+            if (text_array->used_size == (int64_t)text_array->array.max_size)
+                segmented_array_grow(&text_array->array);
+            text_cell(text_array, do_cell(do_array, do_array->used_size)->begin+text_array->last_version_used_size)->text_line = text_cell(text_array, do_cell(do_array, do_array->used_size-1)->begin+end+i)->text_line; //ricopio gli eventuali valori presenti nel vecchio stato
+            text_array->used_size++;
+            INSTR_ADD(lines_copied, 1);
+            text_array->last_version_used_size++;
+        }
+    }
+}
+
+void do_array_delete(do_array_t *do_array, int64_t first_free_slot, int64_t start, int64_t end)
+{
+    if (do_array->used_size + 1 == (int64_t)do_array->array.max_size) //the new state is stored at used_size + 1
+        segmented_array_grow(&do_array->array);
+    do_array->used_size++;
+
+    int64_t previous_version_size = (do_cell(do_array, do_array->used_size-1)->end - do_cell(do_array, do_array->used_size-1)->begin) + 1;
+    if(end < 1 || start > previous_version_size){ //case for a command such as "0,0d" or "-1,-1d" + delete of values subsequent the end
+        do_cell(do_array, do_array->used_size)->begin = first_free_slot;
+        do_cell(do_array, do_array->used_size)->end = do_cell(do_array, do_array->used_size)->begin + previous_version_size -1;
+    } else {
+        do_cell(do_array, do_array->used_size)->begin = first_free_slot;
+
+        int64_t start_delete = max (1,start);
+        int64_t end_delete = min (end, previous_version_size);
+        int64_t number_of_nodes_to_del = end_delete - start_delete + 1;
+        int64_t remaining_nodes = previous_version_size - number_of_nodes_to_del;
+
+        if (remaining_nodes == 0 || remaining_nodes == 1)
+            do_cell(do_array, do_array->used_size)->end = do_cell(do_array, do_array->used_size)->begin;
+        else{
+            do_cell(do_array, do_array->used_size)->end = do_cell(do_array, do_array->used_size)->begin + remaining_nodes - 1;
+        }
+    }
+
+}
+
+void do_array_jump(do_array_t* do_array, dynamic_array_t* text_array, int64_t start_do)
+{
+    if (start_do > 0){ //it has to carry out a number of undo equal to start_do
+        do_array->used_size = do_array->used_size - start_do; //moves to the correct state in the undo/red array
+        if (do_array->used_size == 0)
+            text_array->last_version_used_size = 0;
+        else
+            text_array->last_version_used_size = do_cell(do_array, do_array->used_size)->end - do_cell(do_array, do_array->used_size)->begin + 1;
+        if (!text_array->keep_undone_rows) //the slots after the new current version are reused by the next command
+            text_array->used_size = do_cell(do_array, do_array->used_size)->end + 1;
+    } else if (start_do < 0 ){ //it has to carry out a number of redo equal to (-start_do)
+        do_array->used_size = do_array->used_size - start_do; //because start-do is negative, it is actually summed
+        text_array->last_version_used_size = do_cell(do_array, do_array->used_size)->end - do_cell(do_array, do_array->used_size)->begin + 1;
+        if (!text_array->keep_undone_rows)
+            text_array->used_size = do_cell(do_array, do_array->used_size)->end + 1;
+    }
+}
+
+void array_change_in_place(dynamic_array_t* text_array, do_array_t* do_array, const line_id_t* lines, int64_t start, int64_t end)
+{
+    do_cell_t* version = do_cell(do_array, do_array->used_size);
+    int64_t size = array_version_size(text_array, do_array, do_array->used_size);
+
+    for (int64_t line_number = start; line_number <= end; line_number++){
+        int64_t slot = version->begin + line_number - 1;
+        if (slot == text_array->used_size){ //a new row after the last one
+            if (text_array->used_size == (int64_t)text_array->array.max_size)
+                segmented_array_grow(&text_array->array);
+            text_array->used_size++;
+        }
+        text_cell(text_array, slot)->text_line = lines[line_number - start];
+        INSTR_ADD(lines_copied, 1);
+    }
+    size = max(size, end);
+    version->end = version->begin + size - 1;
+    text_array->last_version_used_size = size;
+}
+
+void array_delete_in_place(dynamic_array_t* text_array, do_array_t* do_array, int64_t start, int64_t end)
+{
+    do_cell_t* version = do_cell(do_array, do_array->used_size);
+    int64_t size = array_version_size(text_array, do_array, do_array->used_size);
+    int64_t start_delete = max(1, start);
+    int64_t end_delete = min(end, size);
+
+    if (start_delete > end_delete) //there are no deletions
+        return;
+    for (int64_t i = end_delete; i < size; i++){ //the following rows move back
+        text_cell(text_array, version->begin + i - (end_delete - start_delete + 1))->text_line = text_cell(text_array, version->begin + i)->text_line;
+        INSTR_ADD(lines_copied, 1);
+    }
+    size = size - (end_delete - start_delete + 1);
+    if (size == 0){ //empty state: one cell, but no rows
+        text_cell(text_array, version->begin)->text_line = empty_state_text;
+        size = 1;
+    }
+    version->end = version->begin + size - 1;
+    text_array->used_size = version->end + 1;
+    text_array->last_version_used_size = size;
+}
+
+int64_t array_version_size(dynamic_array_t* text_array, do_array_t* do_array, int64_t version)
+{
+    if (version == 0) //initial state, its keys -1,-1 would count one row
+        return 0;
+    int64_t size = do_cell(do_array, version)->end - do_cell(do_array, version)->begin + 1;
+    if (size == 1 && text_cell(text_array, do_cell(do_array, version)->begin)->text_line == empty_state_text) //empty state, one cell but no rows
+        return 0;
+    return size;
+}
+
+void read_text_array(dynamic_array_t* text_array, do_array_t* do_array, line_arena_t* arena, int64_t version, int64_t start, int64_t end, line_view_t* views)
+{
+    read_text_slice(text_array, arena, do_cell(do_array, version)->begin, start, end, views);
+}
+
+void read_text_slice(dynamic_array_t* text_array, line_arena_t* arena, int64_t begin, int64_t start, int64_t end, line_view_t* views)
+{
+    for (int64_t i = start-1; i < end; i++) // i < end because also end must be read
+        views[i - start + 1] = line_arena_get(arena, text_cell(text_array, i+begin)->text_line); //takes the i-th row adding an offset specified in the do-array
+}
+
+void array_compact(dynamic_array_t* text_array, do_array_t* do_array, int64_t first, int64_t last)
+{
+    int64_t run_begin = 0, run_end = -1; // slots of the old text array moved together, slices of versions overlap
+    int64_t new_run_begin = 0;
+    int64_t new_size = 0;
+    int64_t version, i;
+
+    for (version = first; version <= last; version++){
+        do_cell_t slice = *do_cell(do_array, version);
+        if (slice.begin > run_end){ //a new run: the previous one is moved to the front, never after its old place
+            for (i = run_begin; i <= run_end; i++)
+                text_cell(text_array, new_size + i - run_begin)->text_line = text_cell(text_array, i)->text_line;
+            new_size = new_size + run_end - run_begin + 1;
+            run_begin = slice.begin;
+            run_end = slice.end;
+            new_run_begin = new_size;
+        } else if (slice.end > run_end) //an in place append extends the slice of the previous version
+            run_end = slice.end;
+
+        do_cell(do_array, version - first + 1)->begin = new_run_begin + slice.begin - run_begin;
+        do_cell(do_array, version - first + 1)->end = new_run_begin + slice.end - run_begin;
+    }
+    for (i = run_begin; i <= run_end; i++)
+        text_cell(text_array, new_size + i - run_begin)->text_line = text_cell(text_array, i)->text_line;
+    new_size = new_size + run_end - run_begin + 1;
+
+    do_array->used_size = do_array->used_size - (first - 1);
+    if (text_array->keep_undone_rows)
+        text_array->used_size = new_size;
+    else //same as after do_array_jump: the slots of the redo versions are reused by the next command
+        text_array->used_size = do_cell(do_array, do_array->used_size)->end + 1;
+    segmented_array_shrink(&text_array->array, new_size);
+    segmented_array_shrink(&do_array->array, last - first + 2);
+}
+
+void array_for_each_line(dynamic_array_t* text_array, do_array_t* do_array, int64_t last, line_visit_t visit, void* context)
+{
+    int64_t size = max(text_array->used_size, do_cell(do_array, last)->end + 1);
+    for (int64_t i = 0; i < size; i++)
+        visit(&text_cell(text_array, i)->text_line, context);
+}
+
+void free_text_array(dynamic_array_t* a)
+{
+    free_segmented_array(&a->array);
+}
+
+void free_do_array(do_array_t* a)
+{
+    free_segmented_array(&a->array);
+}
+
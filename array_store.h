@@ -0,0 +1,246 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_ARRAY_STORE_H
+#define API_PROJECT_MEMENTOPATTERN_ARRAY_STORE_H
+
+#include <stdint.h>
+#include "line_arena.h"
+#include "segmented_array.h"
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Version store made of two arrays (Memento Pattern): the text array contains, one after the other, the rows of every
+ * version; the do array contains for every version the (begin, end) slice of the text array holding its rows.
+ */
+typedef struct cell_s{
+    line_id_t text_line; // 32 bit id resolved by the arena, half the size of a pointer
+} cell_t;
+
+typedef struct dynamic_array_s{
+    segmented_array_t array; // of cell_t
+    int64_t last_version_used_size;
+    int64_t used_size;
+    int keep_undone_rows; // if set undo does not give back the rows of the undone versions, so no slot is ever overwritten
+}dynamic_array_t;
+
+typedef struct do_cell_s{
+    int64_t begin;
+    int64_t end;
+} do_cell_t;
+
+typedef struct do_array_s{
+    segmented_array_t array; // of do_cell_t
+    int64_t used_size;
+}do_array_t;
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static inline cell_t* text_cell(dynamic_array_t* text_array, int64_t index)
+{
+    return (cell_t*)segmented_array_at(&text_array->array, index);
+}
+
+static inline do_cell_t* do_cell(do_array_t* do_array, int64_t index)
+{
+    return (do_cell_t*)segmented_array_at(&do_array->array, index);
+}
+
+/**
+ * Tells if the rows of a change can be appended right after the slice of the current version, which is not true
+ * when the slots after it still hold undone versions (keep_undone_rows)
+ * @param text_array text_array
+ * @param do_array do_array
+ */
+static inline int array_can_append_in_place(dynamic_array_t* text_array, do_array_t* do_array)
+{
+    return !text_array->keep_undone_rows || do_cell(do_array, do_array->used_size)->end + 1 == text_array->used_size;
+}
+
+static inline int64_t min(int64_t a, int64_t b)
+{
+    if (a<b)
+        return a;
+    return b;
+}
+
+static inline int64_t max (int64_t a, int64_t b)
+{
+    if (a > b)
+        return  a;
+    return b;
+}
+
+/* ------------------------------------------------------------------------------------------prototypes ------------------------------------------------------------------------------------------ */
+
+/**
+ * Initializes the array containing the text, segments are allocated on demand
+ * @param a array to allocate
+ */
+void init_text_array(dynamic_array_t* a);
+
+/**
+ * Initializes the array containing the undo/redo indexes, segments are allocated on demand
+ * @param a array to allocate
+ */
+void init_do_array(do_array_t* a);
+
+/**
+ * Initializes both arrays on the cells and the slices of a saved document mapped in memory: their segments are
+ * borrowed, not copied, and the segments added later are allocated as usual
+ * @param text_array text_array to initialize
+ * @param do_array do_array to initialize
+ * @param cells cell_count cells, padded to a whole number of segments
+ * @param cell_count number of cells
+ * @param slices slice_count slices (versions from 0 on), padded to a whole number of segments
+ * @param slice_count number of slices
+ */
+void attach_array_store(dynamic_array_t* text_array, do_array_t* do_array, char* cells, int64_t cell_count, char* slices, int64_t slice_count);
+
+/**
+ * Adds new line in the text array. It is called when there are no rows that will be overwritten
+ * @param text_array array in which text will be added
+ * @param do_array array with the indexes used to speed up undo/redo operations
+ * @param line_number number of line in which the string will be added
+ * @param effective_string string to insert
+ */
+void array_insert_no_replace(dynamic_array_t *text_array, do_array_t *do_array, int64_t line_number, line_id_t effective_string);
+
+/**
+ * Adds newlines in the text array. It is called when there are rows that will be overwritten
+ * @param text_array array in which text will be added
+ * @param do_array array with the indexes used to speed up undo/redo operations
+ * @param lines ids of the new rows, end - start + 1 of them
+ * @param starting index of the command
+ * @param ending index of the command
+ */
+void array_insert_with_replace(dynamic_array_t *text_array, do_array_t *do_array, const line_id_t *lines, int64_t start, int64_t end);
+
+/**
+ * Acknowledges and updates the undo/redo array after an insertion called in a command that does not overwrite an already present row
+ * @param a do_array
+ * @param starting index of the command
+ * @param ending index of the command
+ */
+void do_array_insert_only_no_replace(do_array_t* a, int64_t start, int64_t end);
+
+/**
+ * Acknowledges and updates the undo/redo array after an insertion called in a command that overwrites an already present row
+ * @param do_array do_array
+ * @param first_free_slot slot of the text array where the new version begins (text_array->used_size)
+ * @param end ending index of the command
+ */
+void do_array_insert_with_replace(do_array_t* do_array, int64_t first_free_slot, int64_t end);
+
+/**
+ * Acknowledges and updates the undo/redo array after a delete command
+ * @param do_array do_array
+ * @param first_free_slot slot of the text array where the new version begins (text_array->used_size)
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void do_array_delete(do_array_t *do_array, int64_t first_free_slot, int64_t start, int64_t end);
+
+/**
+ * Acknowledges and updates the text array after a delete command
+ * @param do_array do_array
+ * @param text_array text_array
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void array_delete(do_array_t* do_array, dynamic_array_t* text_array, int64_t start, int64_t end);
+
+/**
+ * Changes the rows of the current version in place instead of creating a new version (no history). The slice of the
+ * current version must be the last one of the text array, since it may grow
+ * @param text_array text_array
+ * @param do_array do_array
+ * @param lines ids of the new rows, end - start + 1 of them
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void array_change_in_place(dynamic_array_t* text_array, do_array_t* do_array, const line_id_t* lines, int64_t start, int64_t end);
+
+/**
+ * Deletes rows of the current version in place, moving the following ones back (no history). The slice of the
+ * current version must be the last one of the text array
+ * @param text_array text_array
+ * @param do_array do_array
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void array_delete_in_place(dynamic_array_t* text_array, do_array_t* do_array, int64_t start, int64_t end);
+
+/**
+ * Moves the current state after a sequence of undo/redo commands
+ * @param do_array do_array
+ * @param text_array text_array
+ * @param start_do number of undo to carry out, if negative number of redo
+ */
+void do_array_jump(do_array_t* do_array, dynamic_array_t* text_array, int64_t start_do);
+
+/**
+ * Returns the number of rows of a version, 0 for the initial and the empty states
+ * @param text_array text_array
+ * @param do_array do_array
+ * @param version index of the version
+ */
+int64_t array_version_size(dynamic_array_t* text_array, do_array_t* do_array, int64_t version);
+
+/**
+ * Reads the text of a version in the text array, both start and end must be valid rows
+ * @param text_array text_array
+ * @param do_array do_array
+ * @param arena arena in which the rows are stored
+ * @param version index of the version, the current one is do_array->used_size
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param views end - start + 1 views filled with the rows, the text is not copied
+ */
+void read_text_array(dynamic_array_t* text_array, do_array_t* do_array, line_arena_t* arena, int64_t version, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Reads the rows of a slice of the text array, both start and end must be valid rows. Only the cells of the slice are
+ * touched, so it can run on a reader thread while the text array grows
+ * @param text_array text_array
+ * @param arena arena in which the rows are stored
+ * @param begin first slot of the slice (do_cell(do_array, version)->begin)
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param views end - start + 1 views filled with the rows, the text is not copied
+ */
+void read_text_slice(dynamic_array_t* text_array, line_arena_t* arena, int64_t begin, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Keeps only the versions from first to last, renumbered from 1 on, and moves their slices to the front of the text
+ * array: slices shared by consecutive versions stay shared. The segments that are no longer needed are freed
+ * @param text_array text_array
+ * @param do_array do_array, its current version must be between first and last
+ * @param first first version to keep, at least 1 (version 0 is the initial state, it is always kept)
+ * @param last last version to keep
+ */
+void array_compact(dynamic_array_t* text_array, do_array_t* do_array, int64_t first, int64_t last);
+
+/**
+ * Calls visit on every slot of the text array up to the end of the last version, redo versions included: after
+ * array_compact they hold exactly the rows of the kept versions
+ * @param text_array text_array
+ * @param do_array do_array
+ * @param last last version of the redo stack
+ * @param visit function called with a pointer to the id, it can change it
+ * @param context passed to visit
+ */
+void array_for_each_line(dynamic_array_t* text_array, do_array_t* do_array, int64_t last, line_visit_t visit, void* context);
+
+/**
+ * Frees the segments of the text array
+ * @param a array to free
+ */
+void free_text_array(dynamic_array_t* a);
+
+/**
+ * Frees the segments of the do array
+ * @param a array to free
+ */
+void free_do_array(do_array_t* a);
+
+
+#endif //API_PROJECT_MEMENTOPATTERN_ARRAY_STORE_H
@@ -0,0 +1,194 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "document.h"
+#include "editor.h"
+#include "instrumentation.h"
+#include "trace_generator.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define CLASS_OPTION "--class"
+#define COMMANDS_OPTION "--commands"
+#define SEED_OPTION "--seed"
+#define WRITE_TRACE_OPTION "--write-trace"
+#define TREE_STORE_OPTION "--tree"
+#define LAZY_EDITS_OPTION "--lazy"
+#define DELTA_STORE_OPTION "--delta"
+#define KEYFRAME_INTERVAL_OPTION "--keyframe"
+#define MAX_UNDO_OPTION "--max-undo"
+#define INTERN_LINES_OPTION "--intern"
+#define DEFAULT_COMMANDS 10000
+#define USAGE_ERROR 2
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static inline int64_t now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static int compare_latencies(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/**
+ * Prints the options and the classes on stderr
+ * @param program name of the executable
+ * @return USAGE_ERROR, the exit code of a wrong command line
+ */
+int usage(const char* program);
+
+/**
+ * Generates the trace of a class in an unlinked file and runs it through the editor, timing every command. The
+ * printed rows go to /dev/null. Meant to run in a process of its own, so the peak RSS is the one of this class
+ * @param profile command mix
+ * @param commands number of commands
+ * @param seed seed of the trace
+ * @param options options of the document
+ * @return 0, 1 if the trace could not be written
+ */
+int run_class(const trace_profile_t* profile, int64_t commands, uint64_t seed, const doc_options_t* options);
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+int usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [%s NAME] [%s N] [%s S] [%s FILE] [%s | %s] [%s] [%s K] [%s N] [%s]\nclasses:", program,
+            CLASS_OPTION, COMMANDS_OPTION, SEED_OPTION, WRITE_TRACE_OPTION, TREE_STORE_OPTION, DELTA_STORE_OPTION,
+            LAZY_EDITS_OPTION, KEYFRAME_INTERVAL_OPTION, MAX_UNDO_OPTION, INTERN_LINES_OPTION);
+    for (int i = 0; i < TRACE_PROFILE_COUNT; i++)
+        fprintf(stderr, " %s", trace_profiles[i].name);
+    fprintf(stderr, "\n");
+    return USAGE_ERROR;
+}
+
+int run_class(const trace_profile_t* profile, int64_t commands, uint64_t seed, const doc_options_t* options)
+{
+    FILE* trace = tmpfile();
+    int output_fd = open("/dev/null", O_WRONLY);
+    int64_t* latencies = malloc(sizeof(int64_t) * (commands + 1));
+    int64_t count = 0;
+    int64_t begin, elapsed;
+    struct rusage usage;
+    editor_t editor;
+    int command;
+
+    if (trace == NULL || output_fd < 0){
+        perror(profile->name);
+        return 1;
+    }
+    trace_generate(trace, profile, commands, seed);
+    fflush(trace);
+
+    INSTR_INSTALL(); //in the child, so every class prints its own counters
+    document_t* doc = doc_create(options);
+    init_editor(&editor, doc, fileno(trace), output_fd); //the trace is mapped, as a redirected input
+    begin = now_ns();
+    do {
+        int64_t command_begin = now_ns();
+        command = editor_step(&editor);
+        latencies[count++] = now_ns() - command_begin;
+    } while (command != EDITOR_QUIT && command != INPUT_END_OF_FILE);
+    free_editor(&editor); //the last prints are written here
+    elapsed = now_ns() - begin;
+
+    getrusage(RUSAGE_SELF, &usage);
+    qsort(latencies, count, sizeof(int64_t), compare_latencies);
+    printf("%-16s %10lld %9.3f %12.0f %10.2f %10.2f %10.1f\n", profile->name, (long long)count, elapsed / 1e9,
+           count / (elapsed / 1e9), latencies[count / 2] / 1e3, latencies[count * 99 / 100] / 1e3, usage.ru_maxrss / 1024.0);
+    fflush(stdout);
+
+    free(latencies);
+    close(output_fd);
+    fclose(trace);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const trace_profile_t* profile = NULL; // NULL for every class
+    int64_t commands = DEFAULT_COMMANDS;
+    uint64_t seed = 1;
+    const char* trace_path = NULL;
+    doc_options_t options;
+    int i, result = 0;
+
+    doc_default_options(&options);
+    options.borrow_lines = 1; // as in the editor, rows are referenced in the mapped trace
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], CLASS_OPTION) == 0 && i + 1 < argc){ //"--class NAME": only this workload class
+            profile = trace_profile(argv[++i]);
+            if (profile == NULL){
+                fprintf(stderr, "unknown class %s\n", argv[i]);
+                return usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[i], COMMANDS_OPTION) == 0 && i + 1 < argc){
+            commands = strtoll(argv[++i], NULL, 10);
+            if (commands < 0)
+                return usage(argv[0]);
+        }
+        else if (strcmp(argv[i], SEED_OPTION) == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], WRITE_TRACE_OPTION) == 0 && i + 1 < argc) //"--write-trace FILE": only writes the trace, for the editor
+            trace_path = argv[++i];
+        else if (strcmp(argv[i], TREE_STORE_OPTION) == 0)
+            options.version_store = DOC_TREE_STORE;
+        else if (strcmp(argv[i], LAZY_EDITS_OPTION) == 0)
+            options.lazy_edits = 1;
+        else if (strcmp(argv[i], DELTA_STORE_OPTION) == 0)
+            options.version_store = DOC_DELTA_STORE;
+        else if (strcmp(argv[i], KEYFRAME_INTERVAL_OPTION) == 0 && i + 1 < argc)
+            options.keyframe_interval = strtoll(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], MAX_UNDO_OPTION) == 0 && i + 1 < argc)
+            options.max_undo_depth = strtoll(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], INTERN_LINES_OPTION) == 0)
+            options.intern_lines = 1;
+        else { //"--help", a typo or a missing value: nothing is run
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return usage(argv[0]);
+        }
+    }
+
+    if (options.max_undo_depth > 0) //as in the editor, rows are copied in the arena that compaction shrinks
+        options.borrow_lines = 0;
+
+    if (trace_path != NULL){
+        if (profile == NULL){
+            fprintf(stderr, "%s needs a class\n", WRITE_TRACE_OPTION);
+            return usage(argv[0]);
+        }
+        FILE* trace = fopen(trace_path, "w");
+        if (trace == NULL){
+            perror(trace_path);
+            return 1;
+        }
+        trace_generate(trace, profile, commands, seed);
+        return fclose(trace) == 0 ? 0 : 1;
+    }
+
+    printf("%-16s %10s %9s %12s %10s %10s %10s\n", "class", "commands", "time (s)", "commands/s", "p50 (us)", "p99 (us)", "peak (MiB)");
+    fflush(stdout); //otherwise every child would print it again
+    for (i = 0; i < TRACE_PROFILE_COUNT; i++){
+        if (profile != NULL && profile != &trace_profiles[i])
+            continue;
+        pid_t child = fork(); //a process per class, so that every peak RSS starts from scratch
+        if (child == 0)
+            return run_class(&trace_profiles[i], commands, seed, &options);
+        int status = 1;
+        if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            result = 1;
+    }
+    return result;
+}
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+#include "delta_store.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static inline delta_version_t* delta_version(delta_store_t* store, int64_t index)
+{
+    return (delta_version_t*)segmented_array_at(&store->versions, index);
+}
+
+static inline line_id_t* delta_log(delta_store_t* store, int64_t index)
+{
+    return (line_id_t*)segmented_array_at(&store->log, index);
+}
+
+static void delta_log_append(delta_store_t* store, line_id_t line)
+{
+    if (store->log_size == (int64_t)store->log.max_size)
+        segmented_array_grow(&store->log);
+    *delta_log(store, store->log_size) = line;
+    store->log_size++;
+    INSTR_ADD(lines_copied, 1);
+}
+
+static void delta_rows_reserve(delta_store_t* store, int64_t size)
+{
+    if (size > store->rows_max_size){
+        store->rows_max_size = size > 2 * store->rows_max_size ? size : 2 * store->rows_max_size;
+        store->rows = realloc(store->rows, store->rows_max_size * sizeof(line_id_t));
+        INSTR_ADD(realloc_events, 1);
+        INSTR_ADD(bytes_allocated, store->rows_max_size * sizeof(line_id_t));
+    }
+}
+
+/**
+ * Applies the command of a version to the working copy, which must hold the version before it
+ * @param store delta store
+ * @param version version to apply
+ */
+static void delta_apply(delta_store_t* store, delta_version_t* version)
+{
+    int64_t i;
+
+    if (version->command == DELTA_CHANGE){
+        delta_rows_reserve(store, version->end);
+        for (i = 0; i < version->end - version->start + 1; i++)
+            store->rows[version->start - 1 + i] = *delta_log(store, version->lines + i);
+        if (version->end > store->rows_size)
+            store->rows_size = version->end;
+    } else {
+        int64_t start = version->start < 1 ? 1 : version->start;
+        int64_t end = version->end > store->rows_size ? store->rows_size : version->end;
+        if (start > end) //there are no deletions
+            return;
+        memmove(store->rows + start - 1, store->rows + end, (store->rows_size - end) * sizeof(line_id_t));
+        store->rows_size = store->rows_size - (end - start + 1);
+    }
+}
+
+/**
+ * Rebuilds a version in the working copy: from the working copy itself if it holds a version between the keyframe
+ * of the target and the target, from the keyframe otherwise
+ * @param store delta store
+ * @param version version to rebuild
+ */
+static void delta_seek(delta_store_t* store, int64_t version)
+{
+    delta_version_t* target = delta_version(store, version);
+    int64_t from;
+
+    if (store->working_version == version)
+        return;
+
+    if (store->working_version >= target->keyframe && store->working_version < version) //versions are a single line: the working copy is on the way
+        from = store->working_version;
+    else {
+        delta_version_t* keyframe = delta_version(store, target->keyframe);
+        delta_rows_reserve(store, keyframe->size);
+        for (int64_t i = 0; i < keyframe->size; i++)
+            store->rows[i] = *delta_log(store, keyframe->keyframe_lines + i);
+        store->rows_size = keyframe->size;
+        from = target->keyframe;
+    }
+
+    for (int64_t i = from + 1; i <= version; i++)
+        delta_apply(store, delta_version(store, i));
+    store->working_version = version;
+}
+
+/**
+ * Stores the version after the current one, writing a keyframe if the last one is keyframe_interval versions behind
+ * @param store delta store, the working copy must hold the current version
+ * @param command DELTA_CHANGE or DELTA_DELETE
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param lines index in the log of the rows of a change
+ */
+static void delta_store_add_version(delta_store_t* store, int command, int64_t start, int64_t end, int64_t lines)
+{
+    if (store->used_size + 1 == (int64_t)store->versions.max_size) //the new version is stored at used_size + 1
+        segmented_array_grow(&store->versions);
+
+    delta_version_t* previous = delta_version(store, store->used_size);
+    delta_version_t* version = delta_version(store, store->used_size + 1);
+    version->command = command;
+    version->start = start;
+    version->end = end;
+    version->lines = lines;
+    delta_apply(store, version);
+    version->size = store->rows_size;
+
+    if (store->used_size + 1 - previous->keyframe >= store->keyframe_interval){ //copies the whole working copy
+        version->keyframe = store->used_size + 1;
+        version->keyframe_lines = store->log_size;
+        for (int64_t i = 0; i < store->rows_size; i++)
+            delta_log_append(store, store->rows[i]);
+    } else {
+        version->keyframe = previous->keyframe;
+        version->keyframe_lines = -1;
+    }
+    version->log_end = store->log_size;
+
+    store->used_size++;
+    store->working_version = store->used_size;
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_delta_store(delta_store_t* store, line_arena_t* arena, int64_t keyframe_interval)
+{
+    init_segmented_array(&store->versions, sizeof(delta_version_t));
+    segmented_array_grow(&store->versions);
+    init_segmented_array(&store->log, sizeof(line_id_t));
+    store->used_size = 0;
+    store->log_size = 0;
+    store->keyframe_interval = keyframe_interval < 1 ? 1 : keyframe_interval;
+
+    delta_version_t* initial = delta_version(store, 0); // initial state is an empty keyframe
+    initial->command = DELTA_CHANGE;
+    initial->start = 0;
+    initial->end = 0;
+    initial->lines = 0;
+    initial->keyframe_lines = 0;
+    initial->keyframe = 0;
+    initial->size = 0;
+    initial->log_end = 0;
+
+    store->rows = NULL;
+    store->rows_size = 0;
+    store->rows_max_size = 0;
+    store->working_version = 0;
+    store->arena = arena;
+}
+
+void delta_store_set_keyframe_interval(delta_store_t* store, int64_t keyframe_interval)
+{
+    store->keyframe_interval = keyframe_interval < 1 ? 1 : keyframe_interval;
+}
+
+int64_t delta_store_size(delta_store_t* store, int64_t version)
+{
+    return delta_version(store, version)->size;
+}
+
+void delta_store_change(delta_store_t* store, int64_t start, int64_t end, const line_id_t* lines)
+{
+    delta_seek(store, store->used_size);
+    store->log_size = delta_version(store, store->used_size)->log_end; //the log of the undone versions is reused
+    int64_t first_line = store->log_size;
+    for (int64_t i = 0; i < end - start + 1; i++)
+        delta_log_append(store, lines[i]);
+    delta_store_add_version(store, DELTA_CHANGE, start, end, first_line);
+}
+
+void delta_store_delete(delta_store_t* store, int64_t start, int64_t end)
+{
+    delta_seek(store, store->used_size);
+    store->log_size = delta_version(store, store->used_size)->log_end;
+    delta_store_add_version(store, DELTA_DELETE, start, end, store->log_size);
+}
+
+void delta_store_read(delta_store_t* store, int64_t version, int64_t start, int64_t end, line_view_t* views)
+{
+    delta_seek(store, version);
+    for (int64_t i = start - 1; i < end; i++)
+        views[i - start + 1] = line_arena_get(store->arena, store->rows[i]);
+}
+
+void delta_store_compact(delta_store_t* store, int64_t first, int64_t last)
+{
+    segmented_array_t old_log = store->log;
+    delta_version_t version;
+    int64_t i;
+
+    delta_seek(store, first);
+    init_segmented_array(&store->log, sizeof(line_id_t));
+    store->log_size = 0;
+
+    version = *delta_version(store, first); // the first version kept becomes a keyframe
+    version.keyframe = 1;
+    version.keyframe_lines = 0;
+    for (i = 0; i < store->rows_size; i++)
+        delta_log_append(store, store->rows[i]);
+    version.lines = store->log_size;
+    version.log_end = store->log_size;
+    *delta_version(store, 1) = version;
+
+    for (int64_t old = first + 1; old <= last; old++){ //versions move to a lower index, the log to a new array
+        version = *delta_version(store, old);
+        if (version.command == DELTA_CHANGE){
+            int64_t lines = store->log_size;
+            for (i = 0; i < version.end - version.start + 1; i++)
+                delta_log_append(store, *(line_id_t*)segmented_array_at(&old_log, version.lines + i));
+            version.lines = lines;
+        } else
+            version.lines = store->log_size;
+        if (version.keyframe_lines >= 0){
+            int64_t keyframe_lines = store->log_size;
+            for (i = 0; i < version.size; i++)
+                delta_log_append(store, *(line_id_t*)segmented_array_at(&old_log, version.keyframe_lines + i));
+            version.keyframe_lines = keyframe_lines;
+        }
+        version.keyframe = version.keyframe < first ? 1 : version.keyframe - first + 1;
+        version.log_end = store->log_size;
+        *delta_version(store, old - first + 1) = version;
+    }
+
+    free_segmented_array(&old_log);
+    segmented_array_shrink(&store->versions, last - first + 2);
+    store->used_size = store->used_size - (first - 1);
+    store->working_version = 1;
+}
+
+void delta_store_for_each_line(delta_store_t* store, line_visit_t visit, void* context)
+{
+    for (int64_t i = 0; i < store->log_size; i++)
+        visit(delta_log(store, i), context);
+    for (int64_t i = 0; i < store->rows_size; i++)
+        visit(&store->rows[i], context);
+}
+
+void free_delta_store(delta_store_t* store)
+{
+    free_segmented_array(&store->versions);
+    free_segmented_array(&store->log);
+    free(store->rows);
+    store->rows = NULL;
+}
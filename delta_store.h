@@ -0,0 +1,122 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_DELTA_STORE_H
+#define API_PROJECT_MEMENTOPATTERN_DELTA_STORE_H
+
+#include <stdint.h>
+#include "line_arena.h"
+#include "segmented_array.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define DELTA_STORE_DEFAULT_KEYFRAME_INTERVAL 64
+#define DELTA_CHANGE 'c'
+#define DELTA_DELETE 'd'
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Version store made of deltas: every version keeps only its command and the rows it adds, and one version every
+ * keyframe_interval also keeps all its rows (a keyframe). A version is rebuilt in the working copy starting from the
+ * nearest keyframe before it, or from the working copy itself if it is on the way: memory grows with the edits
+ * instead of versions x rows, and moving to a version costs at most keyframe_interval deltas.
+ * Rows and keyframes are written one after the other in the log; a new version after some undo reuses the log from
+ * the end of the current one, like the text array does.
+ */
+typedef struct delta_version_s{
+    int command;            // DELTA_CHANGE or DELTA_DELETE, unused by version 0
+    int64_t start;
+    int64_t end;
+    int64_t lines;          // index in the log of the rows added by a change
+    int64_t keyframe_lines; // index in the log of all the rows of the version, -1 if it is not a keyframe
+    int64_t keyframe;       // nearest keyframe at or before this version
+    int64_t size;           // number of rows
+    int64_t log_end;        // first index of the log not used by this version or by the ones before it
+} delta_version_t;
+
+typedef struct delta_store_s{
+    segmented_array_t versions; // of delta_version_t, versions[0] is the initial (empty) state
+    int64_t used_size;          // index of the current version, same meaning as do_array->used_size
+    segmented_array_t log;      // of line_id_t
+    int64_t log_size;
+    int64_t keyframe_interval;
+
+    line_id_t* rows;            // working copy: rows of the version working_version
+    int64_t rows_size;
+    int64_t rows_max_size;
+    int64_t working_version;
+
+    line_arena_t* arena;        // rows referenced by the log
+} delta_store_t;
+
+/**
+ * Initializes the delta store with the empty initial version
+ * @param store store to initialize
+ * @param arena arena in which the rows are stored
+ * @param keyframe_interval number of versions between two keyframes, at least 1
+ */
+void init_delta_store(delta_store_t* store, line_arena_t* arena, int64_t keyframe_interval);
+
+/**
+ * Changes the distance between keyframes, it applies to the versions created from now on
+ * @param store delta store
+ * @param keyframe_interval number of versions between two keyframes, at least 1
+ */
+void delta_store_set_keyframe_interval(delta_store_t* store, int64_t keyframe_interval);
+
+/**
+ * Returns the number of rows of a version
+ * @param store delta store
+ * @param version index of the version, the current one is store->used_size
+ */
+int64_t delta_store_size(delta_store_t* store, int64_t version);
+
+/**
+ * Creates a new version in which rows from start to end are replaced (or added)
+ * @param store delta store
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param lines ids of the end - start + 1 rows
+ */
+void delta_store_change(delta_store_t* store, int64_t start, int64_t end, const line_id_t* lines);
+
+/**
+ * Creates a new version in which rows from start to end are deleted, rows that do not exist are ignored
+ * @param store delta store
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void delta_store_delete(delta_store_t* store, int64_t start, int64_t end);
+
+/**
+ * Reads the rows of a version from start to end; both must be valid rows. The version is rebuilt in the working
+ * copy first, so reading the same version again costs nothing
+ * @param store delta store
+ * @param version index of the version, the current one is store->used_size
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param views end - start + 1 views filled with the rows, the text is not copied
+ */
+void delta_store_read(delta_store_t* store, int64_t version, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Keeps only the versions from first to last, renumbered from 1 on. The log is rebuilt with a keyframe for first,
+ * then the deltas and keyframes of the following versions; the log of the dropped and undone versions is freed
+ * @param store delta store, its current version must be between first and last
+ * @param first first version to keep, at least 1 (version 0 is the initial state, it is always kept)
+ * @param last last version to keep
+ */
+void delta_store_compact(delta_store_t* store, int64_t first, int64_t last);
+
+/**
+ * Calls visit on every row id stored in the log and in the working copy
+ * @param store delta store
+ * @param visit function called with a pointer to the id, it can change it
+ * @param context passed to visit
+ */
+void delta_store_for_each_line(delta_store_t* store, line_visit_t visit, void* context);
+
+/**
+ * Frees the versions, the log and the working copy
+ * @param store store to free
+ */
+void free_delta_store(delta_store_t* store);
+
+#endif //API_PROJECT_MEMENTOPATTERN_DELTA_STORE_H
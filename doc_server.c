@@ -0,0 +1,373 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "doc_server.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define CHANGE 'c'
+#define DELETE 'd'
+#define UNDO 'u'
+#define REDO 'r'
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+typedef struct doc_task_s{
+    doc_task_function_t function;
+    void* argument;
+} doc_task_t;
+
+typedef struct doc_worker_s{
+    pthread_t thread;
+    pthread_mutex_t mutex;   // protects the deque, taken by the owner and by the thieves
+    doc_task_t* tasks;       // ring buffer: the oldest task is at head, the newest at head + count - 1
+    size_t head;
+    size_t count;
+    size_t max_size;         // power of 2
+    struct doc_server_s* server;
+} doc_worker_t;
+
+struct doc_server_s{
+    doc_worker_t* workers;
+    int worker_count;
+    pthread_mutex_t mutex;   // only used to sleep and to wake up
+    pthread_cond_t work_available;
+    pthread_cond_t all_done;
+    long queued_tasks;       // tasks in the deques, atomic
+    long unfinished_tasks;   // tasks submitted and not yet finished, atomic
+    int sleeping_workers;    // atomic
+    int stopping;
+    unsigned int next_worker; // deque used by the submits coming from outside the pool, atomic
+};
+
+typedef struct doc_command_s{
+    char command;
+    int64_t start;
+    int64_t end;
+    line_view_t* lines;      // copy of the views of a change
+} doc_command_t;
+
+struct doc_session_s{
+    document_t* doc;
+    doc_server_t* server;
+    pthread_mutex_t mutex;   // protects the posted commands
+    doc_command_t* commands; // posted, not yet taken by the writer
+    int64_t used_size;
+    int64_t max_size;
+    doc_command_t* batch;    // taken by the writer, applied outside the lock
+    int64_t batch_max_size;
+    int scheduled;           // set while a task applying the commands is submitted or running
+};
+
+static __thread doc_worker_t* current_worker = NULL;
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static void doc_worker_push(doc_worker_t* worker, doc_task_t task)
+{
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->count == worker->max_size){ //unrolls the ring in a buffer twice as big
+        doc_task_t* tasks = malloc(2 * worker->max_size * sizeof(doc_task_t));
+        for (size_t i = 0; i < worker->count; i++)
+            tasks[i] = worker->tasks[(worker->head + i) & (worker->max_size - 1)];
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->head = 0;
+        worker->max_size *= 2;
+    }
+    worker->tasks[(worker->head + worker->count) & (worker->max_size - 1)] = task;
+    __atomic_store_n(&worker->count, worker->count + 1, __ATOMIC_RELAXED); //peeked by the thieves without the lock
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+/**
+ * Takes the newest task of the worker's own deque, the one whose data is most likely still in cache
+ * @param worker worker
+ * @param task filled with the task
+ * @return 1 if a task was taken, 0 if the deque is empty
+ */
+static int doc_worker_pop(doc_worker_t* worker, doc_task_t* task)
+{
+    int found = 0;
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->count > 0){
+        __atomic_store_n(&worker->count, worker->count - 1, __ATOMIC_RELAXED);
+        *task = worker->tasks[(worker->head + worker->count) & (worker->max_size - 1)];
+        found = 1;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return found;
+}
+
+/**
+ * Takes the oldest task of another worker's deque, starting from the next worker
+ * @param worker worker looking for a task
+ * @param task filled with the task
+ * @return 1 if a task was stolen, 0 if every deque is empty
+ */
+static int doc_worker_steal(doc_worker_t* worker, doc_task_t* task)
+{
+    doc_server_t* server = worker->server;
+    int index = (int)(worker - server->workers);
+
+    for (int i = 1; i < server->worker_count; i++){
+        doc_worker_t* victim = &server->workers[(index + i) % server->worker_count];
+        if (__atomic_load_n(&victim->count, __ATOMIC_RELAXED) == 0) //checked without the lock, just to skip empty deques
+            continue;
+        pthread_mutex_lock(&victim->mutex);
+        if (victim->count > 0){
+            *task = victim->tasks[victim->head];
+            victim->head = (victim->head + 1) & (victim->max_size - 1);
+            __atomic_store_n(&victim->count, victim->count - 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&victim->mutex);
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->mutex);
+    }
+    return 0;
+}
+
+static void doc_server_task_done(doc_server_t* server)
+{
+    if (__atomic_sub_fetch(&server->unfinished_tasks, 1, __ATOMIC_SEQ_CST) == 0){
+        pthread_mutex_lock(&server->mutex);
+        pthread_cond_broadcast(&server->all_done);
+        pthread_mutex_unlock(&server->mutex);
+    }
+}
+
+static void* doc_worker_main(void* argument)
+{
+    doc_worker_t* worker = argument;
+    doc_server_t* server = worker->server;
+    doc_task_t task;
+
+    current_worker = worker;
+    for (;;){
+        if (doc_worker_pop(worker, &task) || doc_worker_steal(worker, &task)){
+            __atomic_sub_fetch(&server->queued_tasks, 1, __ATOMIC_SEQ_CST);
+            task.function(task.argument);
+            doc_server_task_done(server);
+            continue;
+        }
+
+        pthread_mutex_lock(&server->mutex);
+        __atomic_add_fetch(&server->sleeping_workers, 1, __ATOMIC_SEQ_CST); //a submit either sees this or is seen by the check below
+        while (__atomic_load_n(&server->queued_tasks, __ATOMIC_SEQ_CST) == 0 && !server->stopping)
+            pthread_cond_wait(&server->work_available, &server->mutex);
+        __atomic_sub_fetch(&server->sleeping_workers, 1, __ATOMIC_SEQ_CST);
+        if (server->stopping && __atomic_load_n(&server->queued_tasks, __ATOMIC_SEQ_CST) == 0){
+            pthread_mutex_unlock(&server->mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&server->mutex);
+    }
+}
+
+/**
+ * Applies the commands posted to a session, it runs on a worker and it is the only writer of the document
+ * @param argument session
+ */
+static void doc_session_run(void* argument)
+{
+    doc_session_t* session = argument;
+    doc_command_t* commands;
+    int64_t count;
+    int64_t max_size;
+
+    for (;;){
+        pthread_mutex_lock(&session->mutex);
+        if (session->used_size == 0){ //the next post submits a new task
+            session->scheduled = 0;
+            pthread_mutex_unlock(&session->mutex);
+            return;
+        }
+        commands = session->commands; //swaps the buffers: the commands are applied while new ones are posted
+        max_size = session->max_size;
+        session->commands = session->batch;
+        session->max_size = session->batch_max_size;
+        session->batch = commands;
+        session->batch_max_size = max_size;
+        count = session->used_size;
+        session->used_size = 0;
+        pthread_mutex_unlock(&session->mutex);
+
+        for (int64_t i = 0; i < count; i++){
+            switch (commands[i].command){
+                case CHANGE:
+                    doc_change(session->doc, commands[i].start, commands[i].end, commands[i].lines);
+                    free(commands[i].lines);
+                    break;
+                case DELETE:
+                    doc_delete(session->doc, commands[i].start, commands[i].end);
+                    break;
+                case UNDO:
+                    doc_undo(session->doc, commands[i].start);
+                    break;
+                case REDO:
+                    doc_redo(session->doc, commands[i].start);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+static void doc_session_post(doc_session_t* session, doc_command_t command)
+{
+    pthread_mutex_lock(&session->mutex);
+    if (session->used_size == session->max_size){
+        session->max_size *= 2;
+        session->commands = realloc(session->commands, session->max_size * sizeof(doc_command_t));
+    }
+    session->commands[session->used_size++] = command;
+    if (!session->scheduled){
+        session->scheduled = 1;
+        doc_server_submit(session->server, doc_session_run, session);
+    }
+    pthread_mutex_unlock(&session->mutex);
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+doc_server_t* doc_server_create(int thread_count)
+{
+    doc_server_t* server = malloc(sizeof(doc_server_t));
+
+    if (thread_count <= 0)
+        thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count <= 0)
+        thread_count = 1;
+
+    server->worker_count = thread_count;
+    server->workers = malloc(thread_count * sizeof(doc_worker_t));
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->work_available, NULL);
+    pthread_cond_init(&server->all_done, NULL);
+    server->queued_tasks = 0;
+    server->unfinished_tasks = 0;
+    server->sleeping_workers = 0;
+    server->stopping = 0;
+    server->next_worker = 0;
+
+    for (int i = 0; i < thread_count; i++){
+        pthread_mutex_init(&server->workers[i].mutex, NULL);
+        server->workers[i].tasks = malloc(DOC_SERVER_DEQUE_INITIAL_SIZE * sizeof(doc_task_t));
+        server->workers[i].head = 0;
+        server->workers[i].count = 0;
+        server->workers[i].max_size = DOC_SERVER_DEQUE_INITIAL_SIZE;
+        server->workers[i].server = server;
+    }
+    for (int i = 0; i < thread_count; i++) //started after every deque exists, since they steal from each other
+        pthread_create(&server->workers[i].thread, NULL, doc_worker_main, &server->workers[i]);
+    return server;
+}
+
+void doc_server_submit(doc_server_t* server, doc_task_function_t function, void* argument)
+{
+    doc_task_t task = {function, argument};
+    doc_worker_t* worker = current_worker;
+
+    if (worker == NULL || worker->server != server) //from outside the pool: the deques are filled in turn
+        worker = &server->workers[__atomic_fetch_add(&server->next_worker, 1, __ATOMIC_RELAXED) % server->worker_count];
+
+    __atomic_add_fetch(&server->unfinished_tasks, 1, __ATOMIC_SEQ_CST);
+    doc_worker_push(worker, task);
+    __atomic_add_fetch(&server->queued_tasks, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&server->sleeping_workers, __ATOMIC_SEQ_CST) > 0){
+        pthread_mutex_lock(&server->mutex);
+        pthread_cond_signal(&server->work_available);
+        pthread_mutex_unlock(&server->mutex);
+    }
+}
+
+void doc_server_wait(doc_server_t* server)
+{
+    pthread_mutex_lock(&server->mutex);
+    while (__atomic_load_n(&server->unfinished_tasks, __ATOMIC_SEQ_CST) > 0)
+        pthread_cond_wait(&server->all_done, &server->mutex);
+    pthread_mutex_unlock(&server->mutex);
+}
+
+void doc_server_destroy(doc_server_t* server)
+{
+    doc_server_wait(server);
+    pthread_mutex_lock(&server->mutex);
+    server->stopping = 1;
+    pthread_cond_broadcast(&server->work_available);
+    pthread_mutex_unlock(&server->mutex);
+
+    for (int i = 0; i < server->worker_count; i++){
+        pthread_join(server->workers[i].thread, NULL);
+        pthread_mutex_destroy(&server->workers[i].mutex);
+        free(server->workers[i].tasks);
+    }
+    pthread_cond_destroy(&server->all_done);
+    pthread_cond_destroy(&server->work_available);
+    pthread_mutex_destroy(&server->mutex);
+    free(server->workers);
+    free(server);
+}
+
+doc_session_t* doc_session_open(doc_server_t* server, const doc_options_t* options)
+{
+    doc_session_t* session = malloc(sizeof(doc_session_t));
+    doc_options_t session_options;
+
+    if (options == NULL)
+        doc_default_options(&session_options);
+    else
+        session_options = *options;
+    session_options.concurrent_reads = 1; //the snapshots are the only way to read a document owned by a worker
+
+    session->doc = doc_create(&session_options);
+    session->server = server;
+    pthread_mutex_init(&session->mutex, NULL);
+    session->commands = malloc(DOC_SESSION_INITIAL_COMMANDS * sizeof(doc_command_t));
+    session->used_size = 0;
+    session->max_size = DOC_SESSION_INITIAL_COMMANDS;
+    session->batch = malloc(DOC_SESSION_INITIAL_COMMANDS * sizeof(doc_command_t));
+    session->batch_max_size = DOC_SESSION_INITIAL_COMMANDS;
+    session->scheduled = 0;
+    return session;
+}
+
+document_t* doc_session_document(doc_session_t* session)
+{
+    return session->doc;
+}
+
+void doc_session_change(doc_session_t* session, int64_t start, int64_t end, const line_view_t* lines)
+{
+    doc_command_t command = {CHANGE, start, end, malloc((end - start + 1) * sizeof(line_view_t))};
+    memcpy(command.lines, lines, (end - start + 1) * sizeof(line_view_t));
+    doc_session_post(session, command);
+}
+
+void doc_session_delete(doc_session_t* session, int64_t start, int64_t end)
+{
+    doc_command_t command = {DELETE, start, end, NULL};
+    doc_session_post(session, command);
+}
+
+void doc_session_undo(doc_session_t* session, int64_t count)
+{
+    doc_command_t command = {UNDO, count, 0, NULL};
+    doc_session_post(session, command);
+}
+
+void doc_session_redo(doc_session_t* session, int64_t count)
+{
+    doc_command_t command = {REDO, count, 0, NULL};
+    doc_session_post(session, command);
+}
+
+void doc_session_close(doc_session_t* session)
+{
+    doc_destroy(session->doc);
+    pthread_mutex_destroy(&session->mutex);
+    free(session->commands);
+    free(session->batch);
+    free(session);
+}
@@ -0,0 +1,103 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_DOC_SERVER_H
+#define API_PROJECT_MEMENTOPATTERN_DOC_SERVER_H
+
+#include <stdint.h>
+#include "document.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define DOC_SERVER_DEQUE_INITIAL_SIZE 256
+#define DOC_SESSION_INITIAL_COMMANDS 64
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Document server: a pool of worker threads, each with its own deque of tasks. A worker takes the newest task of its
+ * deque and, when it is empty, steals the oldest one of another worker, so independent documents spread on the cores.
+ * A session is a document plus the queue of the write commands posted to it: at most one worker at a time applies
+ * them (the writer of the document), in the order they were posted, while any thread reads the published snapshots
+ * with doc_snapshot/doc_snapshot_read/doc_snapshot_release without taking any lock.
+ */
+typedef struct doc_server_s doc_server_t;
+typedef struct doc_session_s doc_session_t;
+
+typedef void (*doc_task_function_t)(void* argument);
+
+/**
+ * Creates the server and starts its workers
+ * @param thread_count number of workers, 0 for one per online core
+ * @return the server
+ */
+doc_server_t* doc_server_create(int thread_count);
+
+/**
+ * Runs a task on one of the workers. Tasks submitted by a worker go in its own deque
+ * @param server server
+ * @param function function to run
+ * @param argument argument of the function
+ */
+void doc_server_submit(doc_server_t* server, doc_task_function_t function, void* argument);
+
+/**
+ * Waits until every submitted task and every posted command has been carried out
+ * @param server server
+ */
+void doc_server_wait(doc_server_t* server);
+
+/**
+ * Waits for the pending work, stops the workers and frees the server. Sessions must be closed before
+ * @param server server
+ */
+void doc_server_destroy(doc_server_t* server);
+
+/**
+ * Opens a session on a new document, concurrent_reads is always set
+ * @param server server whose workers apply the commands
+ * @param options options of the document, NULL for the default ones
+ * @return the session
+ */
+doc_session_t* doc_session_open(doc_server_t* server, const doc_options_t* options);
+
+/**
+ * Returns the document of a session. Only the snapshot functions can be called on it while the session is open
+ * @param session session
+ */
+document_t* doc_session_document(doc_session_t* session);
+
+/**
+ * Posts a change, see doc_change. The views are copied, the text follows the borrow_lines option of the document
+ * @param session session
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param lines end - start + 1 rows, newline included
+ */
+void doc_session_change(doc_session_t* session, int64_t start, int64_t end, const line_view_t* lines);
+
+/**
+ * Posts a delete, see doc_delete
+ * @param session session
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void doc_session_delete(doc_session_t* session, int64_t start, int64_t end);
+
+/**
+ * Posts an undo, see doc_undo
+ * @param session session
+ * @param count number of commands to undo
+ */
+void doc_session_undo(doc_session_t* session, int64_t count);
+
+/**
+ * Posts a redo, see doc_redo
+ * @param session session
+ * @param count number of commands to redo
+ */
+void doc_session_redo(doc_session_t* session, int64_t count);
+
+/**
+ * Frees a session and its document, no command can be pending (see doc_server_wait)
+ * @param session session
+ */
+void doc_session_close(doc_session_t* session);
+
+#endif //API_PROJECT_MEMENTOPATTERN_DOC_SERVER_H
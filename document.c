@@ -0,0 +1,1001 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "document.h"
+#include "array_store.h"
+#include "persistent_tree.h"
+#include "delta_store.h"
+#include "engine_policy.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define PENDING_CHANGE 'c'
+#define PENDING_DELETE 'd'
+#define PENDING_INITIAL_SIZE 64
+#define DOC_COMPACTION_MIN_VERSIONS 1024 // versions beyond max_undo_depth needed to start a compaction
+#define DOC_FILE_MAGIC "MEMENTO1"
+#define DOC_FILE_ALIGNMENT 4096 // sections start at a multiple of the page size
+#define DOC_SPILL_DEFAULT_DIRECTORY "/tmp"
+#define DOC_SPILL_FILE_NAME "/memento-spill-XXXXXX"
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+typedef struct doc_pending_edit_s{
+    int command;        // PENDING_CHANGE or PENDING_DELETE
+    int64_t start;
+    int64_t end;
+    int64_t first_line; // index in pending_lines of the rows of a change
+} doc_pending_edit_t;
+
+/*
+ * Header of a saved document. The sections follow it in this order, positions are offsets from the beginning of the
+ * file so it can be mapped anywhere: the slices of the versions (do_cell_t) and the text cells (cell_t), both padded to
+ * whole segments so the arrays use them in place, the table of the rows (line_slot_t) and the text of the rows
+ */
+typedef struct doc_file_header_s{
+    char magic[8];
+    int64_t slice_count;     // versions from 0 to the last one of the redo stack
+    int64_t current_version; // as an index of the store, like the fields below
+    int64_t undo_floor;
+    int64_t version_offset;
+    int64_t text_used_size;
+    int64_t last_version_used_size;
+    int64_t cell_count;
+    int64_t line_count;
+    int64_t bytes_size;
+    int64_t slices_offset;
+    int64_t cells_offset;
+    int64_t lines_offset;
+    int64_t bytes_offset;
+} doc_file_header_t;
+
+struct doc_snapshot_s{
+    int64_t version;
+    int64_t size;
+    int64_t begin;      // first slot of the rows in the text array, used by DOC_ARRAY_STORE
+    tree_node_t* root;  // used by DOC_TREE_STORE
+    int64_t readers;    // threads holding the snapshot, changed with atomic operations
+    struct doc_snapshot_s* next; // in the list of the retired snapshots, used by the writer only
+};
+
+struct document_s{
+    doc_options_t options;
+    line_arena_t arena;
+    dynamic_array_t text_array; // used by DOC_ARRAY_STORE
+    do_array_t do_array;
+    tree_store_t tree_store;    // used by DOC_TREE_STORE
+    delta_store_t delta_store;  // used by DOC_DELTA_STORE
+
+    int64_t start_do;           // "algebraic sum" of the undo-s (positive) and redo-s (negative) not yet carried out
+    int64_t redo_available;
+    line_id_t* line_ids;        // ids of the rows of the change being applied
+    int64_t line_ids_size;
+
+    segmented_array_t snapshots; // of doc_snapshot_t, when concurrent_reads is set: one more than the snapshots held by readers
+    int64_t snapshots_used_size;
+    doc_snapshot_t* published;   // last snapshot, read by other threads with an atomic load
+    doc_snapshot_t* retired;     // snapshots published before, reused by the next commands once no reader holds them
+
+    doc_pending_edit_t* pending; // edits not yet applied (lazy_edits): pending[i] creates version pending_base + i + 1
+    int64_t pending_used_size;
+    int64_t pending_max_size;
+    line_id_t* pending_lines;    // rows of the pending changes, one block after the other
+    int64_t pending_lines_used_size;
+    int64_t pending_lines_max_size;
+    int64_t pending_base;        // version the first pending edit applies to
+    int64_t pending_current;     // current version once the pending edits and undo/redo are applied
+
+    int64_t undo_floor;          // oldest version undo can reach (max_undo_depth), it only moves forward
+    int64_t version_offset;      // versions dropped by doc_compact: the stores count from 1 again, users see index + version_offset
+
+    char* mapping;               // file loaded by doc_load, NULL otherwise
+    size_t mapping_size;
+
+    int spill_fd;                // backing file of the spilled segments (memory_cap), -1 until the first one
+    int64_t spill_size;
+};
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+/**
+ * Returns the version the store is in, which differs from the current one while undo/redo are pending
+ * @param doc document
+ */
+static int64_t doc_stored_version(document_t* doc)
+{
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        return doc->tree_store.used_size;
+    if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        return doc->delta_store.used_size;
+    return doc->do_array.used_size;
+}
+
+/**
+ * Returns the number of rows of the version the store is in
+ * @param doc document
+ */
+static inline int64_t doc_stored_size(document_t* doc)
+{
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        return tree_store_size(&doc->tree_store, doc->tree_store.used_size);
+    if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        return delta_store_size(&doc->delta_store, doc->delta_store.used_size);
+    return array_version_size(&doc->text_array, &doc->do_array, doc->do_array.used_size);
+}
+
+/**
+ * Carries out the pending undo/redo with a single jump
+ * @param doc document
+ */
+static void doc_apply_undo_redo(document_t* doc)
+{
+    if (doc->start_do == 0)
+        return;
+    INSTR_ADD(jump_distance, doc->start_do > 0 ? doc->start_do : -doc->start_do);
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        doc->tree_store.used_size = doc->tree_store.used_size - doc->start_do; //versions are never modified, moving the index is enough
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        doc->delta_store.used_size = doc->delta_store.used_size - doc->start_do; //the version is rebuilt when it is needed
+    else
+        do_array_jump(&doc->do_array, &doc->text_array, doc->start_do);
+    doc->start_do = 0;
+}
+
+/**
+ * Returns the current version of the applied edits, pending undo/redo included
+ * @param doc document
+ */
+static int64_t doc_version(document_t* doc)
+{
+    return doc_stored_version(doc) - doc->start_do;
+}
+
+static void doc_mark_line(line_id_t* line, void* context)
+{
+    ((unsigned char*)context)[*line] = 1;
+}
+
+static void doc_remap_line(line_id_t* line, void* context)
+{
+    *line = ((line_id_t*)context)[*line];
+}
+
+/**
+ * Calls visit on every row id stored by the version store of the document
+ * @param doc document
+ * @param last last version of the redo stack
+ * @param visit function called with a pointer to the id
+ * @param context passed to visit
+ */
+static void doc_for_each_line(document_t* doc, int64_t last, line_visit_t visit, void* context)
+{
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        tree_store_for_each_line(&doc->tree_store, visit, context);
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        delta_store_for_each_line(&doc->delta_store, visit, context);
+    else
+        array_for_each_line(&doc->text_array, &doc->do_array, last, visit, context);
+}
+
+/**
+ * Moves the undo floor max_undo_depth versions behind a new version. It never goes back, not even when an edit after
+ * some undo makes the redo stack shorter: the versions behind it may have been compacted away already
+ * @param doc document
+ * @param version version just created, as an index of the stores
+ */
+static void doc_raise_undo_floor(document_t* doc, int64_t version)
+{
+    if (!MEMENTO_POLICY_HISTORY)
+        doc->undo_floor = version;
+    else if (doc->options.max_undo_depth > 0)
+        doc->undo_floor = max(doc->undo_floor, version - doc->options.max_undo_depth);
+}
+
+/**
+ * Moves one segment of the text or do array to the backing file, creating it the first time
+ * @param doc document
+ * @param a array whose first segment in memory is moved
+ * @return 0, -1 if the file could not be created or written
+ */
+static int doc_spill_segment(document_t* doc, segmented_array_t* a)
+{
+    if (doc->spill_fd < 0){
+        const char* directory = doc->options.spill_directory != NULL ? doc->options.spill_directory : DOC_SPILL_DEFAULT_DIRECTORY;
+        char* path = malloc(strlen(directory) + sizeof(DOC_SPILL_FILE_NAME));
+        strcpy(path, directory);
+        strcat(path, DOC_SPILL_FILE_NAME);
+        doc->spill_fd = mkstemp(path);
+        if (doc->spill_fd >= 0)
+            unlink(path); //only the mapped segments keep it alive, it is gone when the process ends
+        free(path);
+        if (doc->spill_fd < 0)
+            return -1;
+    }
+    off_t offset = segmented_array_released_offset(a); //the place of a segment dropped by doc_compact comes first
+    if (offset >= 0)
+        return segmented_array_spill(a, doc->spill_fd, offset);
+    if (segmented_array_spill(a, doc->spill_fd, doc->spill_size) != 0)
+        return -1;
+    doc->spill_size = doc->spill_size + SEGMENT_SIZE * a->element_size;
+    return 0;
+}
+
+/**
+ * Keeps the segments of the versions in memory within memory_cap, moving the oldest ones to the backing file. Only
+ * segments that end before the slice of the current version are moved: the next versions are built from it and the
+ * slots after it, so recent edits and prints never touch the file, undo jumps and prints of old versions map it back
+ * @param doc document
+ */
+static void doc_spill_history(document_t* doc)
+{
+    segmented_array_t* cells = &doc->text_array.array;
+    segmented_array_t* slices = &doc->do_array.array;
+    int64_t hot_cell, hot_slice;
+    int spilled = 0;
+
+    if (doc->options.memory_cap <= 0 || DOC_STORE(doc) != DOC_ARRAY_STORE)
+        return;
+    hot_cell = do_cell(&doc->do_array, doc->do_array.used_size)->begin;
+    hot_slice = doc->do_array.used_size; //the next edit reads the slice of the current version
+    while (spilled == 0 && (int64_t)(segmented_array_heap_size(cells) + segmented_array_heap_size(slices)) > doc->options.memory_cap){
+        if ((int64_t)(cells->borrowed_count + cells->spilled_count + 1) * SEGMENT_SIZE <= hot_cell)
+            spilled = doc_spill_segment(doc, cells);
+        else if ((int64_t)(slices->borrowed_count + slices->spilled_count + 1) * SEGMENT_SIZE <= hot_slice)
+            spilled = doc_spill_segment(doc, slices);
+        else
+            return;
+    }
+    if (spilled != 0) //no room for the file: everything stays in memory
+        doc->options.memory_cap = 0;
+}
+
+/**
+ * Tells whether an edit can change the current version in place (MEMENTO_POLICY_HISTORY set to 0): it is the only one
+ * undo can reach, there is nothing to redo and its slice is the last one of the text array, so it can grow
+ * @param doc document, its undo/redo already applied
+ */
+static inline int doc_edit_in_place(document_t* doc)
+{
+    return !MEMENTO_POLICY_HISTORY && doc->do_array.used_size > 0 && doc->undo_floor == doc->do_array.used_size && doc->redo_available == 0
+           && do_cell(&doc->do_array, doc->do_array.used_size)->end + 1 == doc->text_array.used_size;
+}
+
+static line_id_t doc_store_line(document_t* doc, const line_view_t* line)
+{
+    return line_arena_intern_line(&doc->arena, line->text, line->length, !doc->options.borrow_lines);
+}
+
+/**
+ * Stores the rows of a change in the arena
+ * @param doc document
+ * @param lines rows to store
+ * @param count number of rows
+ * @param ids filled with the ids of the rows
+ */
+static void doc_store_lines(document_t* doc, const line_view_t* lines, int64_t count, line_id_t* ids)
+{
+    for (int64_t i = 0; i < count; i++)
+        ids[i] = doc_store_line(doc, &lines[i]);
+}
+
+/**
+ * Returns a snapshot to fill: a retired one that no reader holds, or a new one. A retired snapshot is not published
+ * anymore, so once its count is zero no reader can take it again (doc_snapshot checks that it is still published after
+ * counting itself in)
+ * @param doc document
+ * @return the snapshot
+ */
+static doc_snapshot_t* doc_new_snapshot(document_t* doc)
+{
+    doc_snapshot_t** link;
+    doc_snapshot_t* snapshot;
+
+    for (link = &doc->retired; *link != NULL; link = &(*link)->next){
+        if (__atomic_load_n(&(*link)->readers, __ATOMIC_SEQ_CST) == 0){
+            snapshot = *link;
+            *link = snapshot->next;
+            return snapshot;
+        }
+    }
+    if (doc->snapshots_used_size == (int64_t)doc->snapshots.max_size)
+        segmented_array_grow(&doc->snapshots);
+    snapshot = segmented_array_at(&doc->snapshots, doc->snapshots_used_size++);
+    __atomic_store_n(&snapshot->readers, 0, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+/**
+ * Publishes the current version for the reader threads. The snapshot is filled before the atomic store, so a reader
+ * that loads it also sees the rows and the cells it points to. The one published before is retired
+ * @param doc document
+ */
+static void doc_publish(document_t* doc)
+{
+    if (!doc->options.concurrent_reads)
+        return;
+
+    doc_snapshot_t* previous = doc->published;
+    doc_snapshot_t* snapshot = doc_new_snapshot(doc);
+    snapshot->version = doc_current_version(doc);
+    snapshot->size = doc_size(doc);
+    if (DOC_STORE(doc) == DOC_TREE_STORE){ //undo/redo may be pending: the version is read from its own root
+        snapshot->root = doc->tree_store.versions[doc_version(doc)];
+        snapshot->begin = 0;
+    } else {
+        snapshot->root = NULL;
+        snapshot->begin = do_cell(&doc->do_array, doc_version(doc))->begin;
+    }
+    __atomic_store_n(&doc->published, snapshot, __ATOMIC_SEQ_CST); //ordered before the counts read by the next doc_new_snapshot
+    if (previous != NULL){
+        previous->next = doc->retired;
+        doc->retired = previous;
+    }
+}
+
+/**
+ * Creates the version of a change whose rows are already in the arena
+ * @param doc document
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param lines ids of the end - start + 1 rows
+ */
+static void doc_apply_change(document_t* doc, int64_t start, int64_t end, const line_id_t* lines)
+{
+    int64_t line_number;
+
+    doc_apply_undo_redo(doc);
+    if (doc_edit_in_place(doc)){ //no history: the new version takes the place of the current one, with its number
+        array_change_in_place(&doc->text_array, &doc->do_array, lines, start, end);
+        doc->version_offset++;
+    } else if (DOC_STORE(doc) == DOC_TREE_STORE){
+        for (line_number = start; line_number <= end; line_number++)
+            tree_store_push_line(&doc->tree_store, lines[line_number - start]);
+        tree_store_change(&doc->tree_store, start, end);
+    } else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        delta_store_change(&doc->delta_store, start, end, lines);
+    else if (start > doc->text_array.last_version_used_size && array_can_append_in_place(&doc->text_array, &doc->do_array)){ //case in which are added elements in the array without overwriting an already present row
+        do_array_insert_only_no_replace(&doc->do_array, start, end);
+        for (line_number = start; line_number <= end; line_number++)
+            array_insert_no_replace(&doc->text_array, &doc->do_array, line_number, lines[line_number - start]);
+    } else { //case in which at least one element has to be overwritten
+        do_array_insert_with_replace(&doc->do_array, doc->text_array.used_size, end);
+        array_insert_with_replace(&doc->text_array, &doc->do_array, lines, start, end);
+    }
+    doc->redo_available = 0; //"empty" stack_redo
+    doc_raise_undo_floor(doc, doc_version(doc));
+    INSTR_ADD(versions_built, 1);
+    INSTR_ADD(version_rows, doc_stored_size(doc));
+    INSTR_MAX(max_version_rows, doc_stored_size(doc));
+    doc_spill_history(doc);
+    doc_publish(doc);
+}
+
+static void doc_apply_delete(document_t* doc, int64_t start, int64_t end)
+{
+    doc_apply_undo_redo(doc);
+    if (doc_edit_in_place(doc)){
+        array_delete_in_place(&doc->text_array, &doc->do_array, start, end);
+        doc->version_offset++;
+    } else if (DOC_STORE(doc) == DOC_TREE_STORE)
+        tree_store_delete(&doc->tree_store, start, end);
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        delta_store_delete(&doc->delta_store, start, end);
+    else {
+        do_array_delete(&doc->do_array, doc->text_array.used_size, start, end);
+        array_delete(&doc->do_array, &doc->text_array, start, end);
+    }
+    doc->redo_available = 0; //"empty" stack_redo
+    doc_raise_undo_floor(doc, doc_version(doc));
+    INSTR_ADD(versions_built, 1);
+    INSTR_ADD(version_rows, doc_stored_size(doc));
+    INSTR_MAX(max_version_rows, doc_stored_size(doc));
+    doc_spill_history(doc);
+    doc_publish(doc);
+}
+
+static void doc_apply_undo(document_t* doc, int64_t count)
+{
+    count = min(count, doc_version(doc) - doc->undo_floor);
+    doc->start_do = doc->start_do + count; //undo-s are counted as positive
+    doc->redo_available = doc->redo_available + count;
+    doc_publish(doc);
+}
+
+static void doc_apply_redo(document_t* doc, int64_t count)
+{
+    count = min(count, doc->redo_available);
+    doc->start_do = doc->start_do - count; //redo-s are counted as negative
+    doc->redo_available = doc->redo_available - count;
+    doc_publish(doc);
+}
+
+/**
+ * Queues an edit instead of applying it (lazy_edits). The pending edits after the current version are dropped: the
+ * new edit empties the redo stack, so nobody can read them anymore and their versions are never built
+ * @param doc document
+ * @param command PENDING_CHANGE or PENDING_DELETE
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param lines rows of a change, NULL for a delete
+ */
+static void doc_buffer_edit(document_t* doc, int command, int64_t start, int64_t end, const line_view_t* lines)
+{
+    if (doc->pending_used_size == 0)
+        doc->pending_base = doc->pending_current = doc_version(doc);
+    else if (doc->pending_current < doc->pending_base){ //undone below the first pending edit: all of them are dropped
+        doc->start_do = doc->start_do + doc->pending_base - doc->pending_current; //already limited by doc_undo
+        doc->redo_available = doc->redo_available + doc->pending_base - doc->pending_current;
+        doc->pending_base = doc->pending_current;
+        doc->pending_used_size = 0;
+        doc->pending_lines_used_size = 0;
+    } else if (doc->pending_current - doc->pending_base < doc->pending_used_size){ //drops the undone edits, with their rows
+        doc->pending_used_size = doc->pending_current - doc->pending_base;
+        doc->pending_lines_used_size = doc->pending[doc->pending_used_size].first_line;
+    }
+
+    if (doc->pending_used_size == doc->pending_max_size){
+        doc->pending_max_size = doc->pending_max_size == 0 ? PENDING_INITIAL_SIZE : 2 * doc->pending_max_size;
+        doc->pending = realloc(doc->pending, doc->pending_max_size * sizeof(doc_pending_edit_t));
+        INSTR_ADD(realloc_events, 1);
+    }
+    doc_pending_edit_t* edit = &doc->pending[doc->pending_used_size++];
+    edit->command = command;
+    edit->start = start;
+    edit->end = end;
+    edit->first_line = doc->pending_lines_used_size;
+
+    if (command == PENDING_CHANGE){
+        if (doc->pending_lines_used_size + end - start + 1 > doc->pending_lines_max_size){
+            doc->pending_lines_max_size = max(2 * doc->pending_lines_max_size, doc->pending_lines_used_size + end - start + 1);
+            doc->pending_lines = realloc(doc->pending_lines, doc->pending_lines_max_size * sizeof(line_id_t));
+            INSTR_ADD(realloc_events, 1);
+        }
+        doc_store_lines(doc, lines, end - start + 1, doc->pending_lines + doc->pending_lines_used_size);
+        doc->pending_lines_used_size = doc->pending_lines_used_size + end - start + 1;
+    }
+    doc->pending_current++;
+    doc_raise_undo_floor(doc, doc->pending_current);
+}
+
+/**
+ * Compacts the document once the versions beyond max_undo_depth are as many as the depth (at least
+ * DOC_COMPACTION_MIN_VERSIONS): every compaction copies the kept versions, so memory stays within twice the depth
+ * and the copy is paid back by the edits in between
+ * @param doc document, no edit can be pending
+ */
+static void doc_bound_history(document_t* doc)
+{
+    if (doc->options.max_undo_depth > 0 && doc->undo_floor - 1 >= max(doc->options.max_undo_depth, DOC_COMPACTION_MIN_VERSIONS))
+        doc_compact(doc);
+}
+
+/**
+ * Builds the versions of the pending edits that survived and moves to the current version, it is called before
+ * every read
+ * @param doc document
+ */
+static void doc_materialize(document_t* doc)
+{
+    if (doc->pending_used_size == 0)
+        return;
+
+    for (int64_t i = 0; i < doc->pending_used_size; i++){
+        doc_pending_edit_t* edit = &doc->pending[i];
+        if (edit->command == PENDING_CHANGE)
+            doc_apply_change(doc, edit->start, edit->end, doc->pending_lines + edit->first_line);
+        else
+            doc_apply_delete(doc, edit->start, edit->end);
+    }
+    doc_apply_undo(doc, doc->pending_base + doc->pending_used_size - doc->pending_current); //the undone edits stay in the redo stack
+    doc->pending_used_size = 0;
+    doc->pending_lines_used_size = 0;
+    doc_bound_history(doc);
+}
+
+static int64_t doc_file_align(int64_t offset)
+{
+    return (offset + DOC_FILE_ALIGNMENT - 1) / DOC_FILE_ALIGNMENT * DOC_FILE_ALIGNMENT;
+}
+
+/**
+ * Returns the bytes taken in a saved document by the elements of a segmented array, padded to whole segments
+ * @param count number of elements
+ * @param element_size size of an element
+ */
+static int64_t doc_file_segments_size(int64_t count, size_t element_size)
+{
+    return (count + SEGMENT_SIZE - 1) / SEGMENT_SIZE * SEGMENT_SIZE * (int64_t)element_size;
+}
+
+/**
+ * Writes the first count elements of a segmented array at a position of the file, the padding is left as a hole
+ * @param file file
+ * @param offset position of the section
+ * @param a array
+ * @param count number of elements
+ */
+static void doc_file_write_array(FILE* file, int64_t offset, segmented_array_t* a, int64_t count)
+{
+    fseeko(file, offset, SEEK_SET);
+    for (int64_t i = 0; i < count; i += SEGMENT_SIZE)
+        fwrite(a->segments[i >> SEGMENT_SHIFT], a->element_size, min(SEGMENT_SIZE, count - i), file);
+}
+
+/**
+ * Tells whether a section of a saved document fits between its offset and the next one
+ * @param offset position of the section, a multiple of DOC_FILE_ALIGNMENT
+ * @param count number of elements, checked before the size is computed so it can't overflow
+ * @param element_size size of an element
+ * @param padded set if the section is padded to whole segments
+ * @param next position of the next section
+ * @return 1 if it fits, 0 otherwise
+ */
+static int doc_file_section_fits(int64_t offset, int64_t count, size_t element_size, int padded, int64_t next)
+{
+    if (offset % DOC_FILE_ALIGNMENT != 0 || offset > next || count < 0 || count > (next - offset) / (int64_t)element_size)
+        return 0;
+    return (padded ? doc_file_segments_size(count, element_size) : count * (int64_t)element_size) <= next - offset;
+}
+
+/**
+ * Checks the header of a saved document before anything in the file is used: the sections must be in order and fit in
+ * the file, and the state must be one doc_save can write
+ * @param header header, at the beginning of the mapping
+ * @param file_size size of the file
+ * @return 1 if the document can be loaded, 0 otherwise
+ */
+static int doc_file_check_header(const doc_file_header_t* header, int64_t file_size)
+{
+    if (memcmp(header->magic, DOC_FILE_MAGIC, sizeof(header->magic)) != 0 || header->slices_offset < (int64_t)sizeof(doc_file_header_t))
+        return 0;
+    if (!doc_file_section_fits(header->slices_offset, header->slice_count, sizeof(do_cell_t), 1, header->cells_offset)
+        || !doc_file_section_fits(header->cells_offset, header->cell_count, sizeof(cell_t), 1, header->lines_offset)
+        || !doc_file_section_fits(header->lines_offset, header->line_count, sizeof(line_slot_t), 0, min(header->bytes_offset, file_size))
+        || !doc_file_section_fits(header->bytes_offset, header->bytes_size, 1, 0, max(header->bytes_offset, file_size))) //no text: the file ends with the rows
+        return 0;
+    if (header->undo_floor < 0 || header->undo_floor > header->current_version || header->current_version >= header->slice_count)
+        return 0;
+    if (header->line_count < 1 || header->line_count > (int64_t)LINE_ARENA_MAX_LINES) //the empty state row is always saved
+        return 0;
+    return header->text_used_size >= 0 && header->text_used_size <= header->cell_count
+        && header->last_version_used_size >= 0 && header->last_version_used_size <= header->cell_count
+        && header->version_offset >= 0;
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void doc_default_options(doc_options_t* options)
+{
+    options->version_store = DOC_ARRAY_STORE;
+    options->borrow_lines = 0;
+    options->concurrent_reads = 0;
+    options->lazy_edits = 0;
+    options->intern_lines = 0;
+    options->memory_cap = 0;
+    options->spill_directory = NULL;
+    options->keyframe_interval = DELTA_STORE_DEFAULT_KEYFRAME_INTERVAL;
+    options->max_undo_depth = 0;
+}
+
+document_t* doc_create(const doc_options_t* options)
+{
+    document_t* doc = malloc(sizeof(document_t));
+
+    if (options == NULL)
+        doc_default_options(&doc->options);
+    else
+        doc->options = *options;
+    if (MEMENTO_POLICY_STORE != DOC_ANY_STORE)
+        doc->options.version_store = MEMENTO_POLICY_STORE;
+    if (!MEMENTO_POLICY_HISTORY){ //versions are edited in place, nothing older can be read or moved
+        doc->options.concurrent_reads = 0;
+        doc->options.lazy_edits = 0;
+        doc->options.memory_cap = 0;
+        doc->options.max_undo_depth = 0;
+    }
+    if (DOC_STORE(doc) == DOC_DELTA_STORE) //reading a version rebuilds it in the working copy, it can't be shared
+        doc->options.concurrent_reads = 0;
+    if (doc->options.concurrent_reads){ //every command has to publish its version, and published versions are never moved
+        doc->options.lazy_edits = 0;
+        doc->options.max_undo_depth = 0;
+        doc->options.memory_cap = 0;
+    }
+    if (doc->options.keyframe_interval < 1)
+        doc->options.keyframe_interval = DELTA_STORE_DEFAULT_KEYFRAME_INTERVAL;
+
+    init_line_arena(&doc->arena);
+    if (doc->options.intern_lines) //repeated rows get the id of the first one
+        line_arena_enable_interning(&doc->arena);
+    if (DOC_STORE(doc) == DOC_TREE_STORE) //versions are roots of a persistent tree: a change copies only the touched paths
+        init_tree_store(&doc->tree_store, &doc->arena, TREE_STORE_INITIAL_VERSIONS);
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE) //versions are deltas, with a full copy every keyframe_interval
+        init_delta_store(&doc->delta_store, &doc->arena, doc->options.keyframe_interval);
+    else {
+        init_text_array(&doc->text_array);
+        init_do_array(&doc->do_array);
+        doc->text_array.keep_undone_rows = doc->options.concurrent_reads; //a reader may still be reading an undone version
+    }
+    doc->start_do = 0;
+    doc->redo_available = 0;
+    doc->line_ids = NULL;
+    doc->line_ids_size = 0;
+    init_segmented_array(&doc->snapshots, sizeof(doc_snapshot_t));
+    doc->snapshots_used_size = 0;
+    doc->published = NULL;
+    doc->retired = NULL;
+    doc->pending = NULL;
+    doc->pending_used_size = 0;
+    doc->pending_max_size = 0;
+    doc->pending_lines = NULL;
+    doc->pending_lines_used_size = 0;
+    doc->pending_lines_max_size = 0;
+    doc->pending_base = 0;
+    doc->pending_current = 0;
+    doc->undo_floor = 0;
+    doc->version_offset = 0;
+    doc->mapping = NULL;
+    doc->mapping_size = 0;
+    doc->spill_fd = -1;
+    doc->spill_size = 0;
+    doc_publish(doc);
+    return doc;
+}
+
+void doc_destroy(document_t* doc)
+{
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        free_tree_store(&doc->tree_store);
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        free_delta_store(&doc->delta_store);
+    else {
+        free_text_array(&doc->text_array);
+        free_do_array(&doc->do_array);
+    }
+    free_line_arena(&doc->arena);
+    free_segmented_array(&doc->snapshots);
+    free(doc->line_ids);
+    free(doc->pending);
+    free(doc->pending_lines);
+    if (doc->mapping != NULL)
+        munmap(doc->mapping, doc->mapping_size);
+    if (doc->spill_fd >= 0)
+        close(doc->spill_fd);
+    free(doc);
+}
+
+int doc_save(document_t* doc, const char* path)
+{
+    doc_file_header_t header;
+    line_slot_t slot;
+    line_t line;
+    line_id_t id;
+    char* temporary_path;
+    FILE* file;
+    int64_t latest;
+    int failed;
+
+    if (DOC_STORE(doc) != DOC_ARRAY_STORE){
+        errno = ENOTSUP;
+        return -1;
+    }
+    doc_materialize(doc);
+    doc_apply_undo_redo(doc);
+    latest = doc_version(doc) + doc->redo_available;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DOC_FILE_MAGIC, sizeof(header.magic));
+    header.slice_count = latest + 1;
+    header.current_version = doc_version(doc);
+    header.undo_floor = doc->undo_floor;
+    header.version_offset = doc->version_offset;
+    header.text_used_size = doc->text_array.used_size;
+    header.last_version_used_size = doc->text_array.last_version_used_size;
+    header.cell_count = max(doc->text_array.used_size, do_cell(&doc->do_array, latest)->end + 1); //the redo versions may be after used_size
+    header.line_count = doc->arena.used_size;
+    for (id = 0; id < doc->arena.used_size; id++)
+        header.bytes_size = header.bytes_size + (int64_t)line_arena_get(&doc->arena, id).length;
+    header.slices_offset = doc_file_align(sizeof(header));
+    header.cells_offset = doc_file_align(header.slices_offset + doc_file_segments_size(header.slice_count, sizeof(do_cell_t)));
+    header.lines_offset = doc_file_align(header.cells_offset + doc_file_segments_size(header.cell_count, sizeof(cell_t)));
+    header.bytes_offset = doc_file_align(header.lines_offset + header.line_count * (int64_t)sizeof(line_slot_t));
+
+    temporary_path = malloc(strlen(path) + sizeof(".tmp"));
+    strcpy(temporary_path, path);
+    strcat(temporary_path, ".tmp"); //written aside and renamed, so a document loaded from path keeps its (mapped) file
+    file = fopen(temporary_path, "wb");
+    if (file == NULL){
+        free(temporary_path);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    doc_file_write_array(file, header.slices_offset, &doc->do_array.array, header.slice_count);
+    doc_file_write_array(file, header.cells_offset, &doc->text_array.array, header.cell_count);
+
+    fseeko(file, header.lines_offset, SEEK_SET);
+    slot.offset = 0;
+    for (id = 0; id < doc->arena.used_size; id++){
+        slot.length = line_arena_get(&doc->arena, id).length;
+        fwrite(&slot, sizeof(slot), 1, file);
+        slot.offset = slot.offset + slot.length;
+    }
+    fseeko(file, header.bytes_offset, SEEK_SET);
+    for (id = 0; id < doc->arena.used_size; id++){
+        line = line_arena_get(&doc->arena, id);
+        fwrite(line.text, 1, line.length, file);
+    }
+
+    failed = ferror(file);
+    failed = fclose(file) != 0 || failed;
+    if (!failed)
+        failed = rename(temporary_path, path) != 0;
+    if (failed)
+        unlink(temporary_path);
+    free(temporary_path);
+    return failed ? -1 : 0;
+}
+
+document_t* doc_load(const char* path, const doc_options_t* options)
+{
+    doc_options_t load_options;
+    doc_file_header_t* header;
+    struct stat file_status;
+    document_t* doc;
+    char* mapping;
+    int fd;
+
+    if (MEMENTO_POLICY_STORE != DOC_ANY_STORE && MEMENTO_POLICY_STORE != DOC_ARRAY_STORE){
+        errno = ENOTSUP;
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &file_status) != 0 || file_status.st_size < (off_t)sizeof(doc_file_header_t)){
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    mapping = mmap(NULL, file_status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0); //copy on write: new versions never reach the file
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return NULL;
+    header = (doc_file_header_t*)mapping;
+    if (!doc_file_check_header(header, file_status.st_size)){ //truncated or not written by doc_save
+        munmap(mapping, file_status.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (options == NULL)
+        doc_default_options(&load_options);
+    else
+        load_options = *options;
+    load_options.version_store = DOC_ARRAY_STORE;
+    doc = doc_create(&load_options);
+    free_text_array(&doc->text_array); //replaced by the mapped ones, pages are read when they are needed
+    free_do_array(&doc->do_array);
+    free_line_arena(&doc->arena);
+
+    attach_array_store(&doc->text_array, &doc->do_array, mapping + header->cells_offset, header->cell_count,
+                       mapping + header->slices_offset, header->slice_count);
+    doc->text_array.keep_undone_rows = doc->options.concurrent_reads;
+    doc->text_array.used_size = header->text_used_size;
+    doc->text_array.last_version_used_size = header->last_version_used_size;
+    doc->do_array.used_size = header->current_version;
+    line_arena_attach(&doc->arena, (const line_slot_t*)(mapping + header->lines_offset), mapping + header->bytes_offset, (line_id_t)header->line_count);
+    if (doc->options.intern_lines)
+        line_arena_enable_interning(&doc->arena);
+
+    doc->redo_available = header->slice_count - 1 - header->current_version;
+    doc->undo_floor = header->undo_floor;
+    doc->version_offset = header->version_offset;
+    doc->mapping = mapping;
+    doc->mapping_size = file_status.st_size;
+    doc_publish(doc);
+    return doc;
+}
+
+void doc_change(document_t* doc, int64_t start, int64_t end, const line_view_t* lines)
+{
+    if (doc->options.lazy_edits){
+        doc_buffer_edit(doc, PENDING_CHANGE, start, end, lines);
+        return;
+    }
+    if (end - start + 1 > doc->line_ids_size){
+        doc->line_ids_size = end - start + 1;
+        doc->line_ids = realloc(doc->line_ids, doc->line_ids_size * sizeof(line_id_t));
+        INSTR_ADD(realloc_events, 1);
+    }
+    doc_store_lines(doc, lines, end - start + 1, doc->line_ids);
+    doc_apply_change(doc, start, end, doc->line_ids);
+    doc_bound_history(doc);
+}
+
+void doc_delete(document_t* doc, int64_t start, int64_t end)
+{
+    if (doc->options.lazy_edits)
+        doc_buffer_edit(doc, PENDING_DELETE, start, end, NULL);
+    else {
+        doc_apply_delete(doc, start, end);
+        doc_bound_history(doc);
+    }
+}
+
+void doc_undo(document_t* doc, int64_t count)
+{
+    if (doc->pending_used_size > 0) //only moves inside the pending edits, see doc_buffer_edit
+        doc->pending_current = doc->pending_current - min(count, doc->pending_current - doc->undo_floor);
+    else
+        doc_apply_undo(doc, count);
+}
+
+void doc_redo(document_t* doc, int64_t count)
+{
+    if (doc->pending_used_size > 0)
+        doc->pending_current = doc->pending_current + min(count, doc->pending_base + doc->pending_used_size - doc->pending_current);
+    else
+        doc_apply_redo(doc, count);
+}
+
+void doc_set_keyframe_interval(document_t* doc, int64_t keyframe_interval)
+{
+    if (keyframe_interval < 1)
+        keyframe_interval = 1;
+    doc->options.keyframe_interval = keyframe_interval;
+    if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        delta_store_set_keyframe_interval(&doc->delta_store, keyframe_interval);
+}
+
+void doc_intern_stats(document_t* doc, doc_intern_stats_t* stats)
+{
+    stats->lookups = (int64_t)doc->arena.intern_stats.lookups;
+    stats->hits = (int64_t)doc->arena.intern_stats.hits;
+    stats->bytes_saved = (int64_t)doc->arena.intern_stats.bytes_saved;
+}
+
+int64_t doc_current_version(document_t* doc)
+{
+    if (doc->pending_used_size > 0)
+        return doc->pending_current + doc->version_offset;
+    return doc_version(doc) + doc->version_offset;
+}
+
+int64_t doc_latest_version(document_t* doc)
+{
+    if (doc->pending_used_size > 0)
+        return doc->pending_base + doc->pending_used_size + doc->version_offset;
+    return doc_version(doc) + doc->redo_available + doc->version_offset;
+}
+
+int64_t doc_oldest_version(document_t* doc)
+{
+    return doc->undo_floor + doc->version_offset;
+}
+
+void doc_compact(document_t* doc)
+{
+    int64_t first, last;
+    unsigned char* live;
+    line_id_t* remap;
+
+    doc_materialize(doc);
+    doc_apply_undo_redo(doc);
+    last = doc_version(doc) + doc->redo_available;
+    first = max(1, doc->undo_floor); //version 0 is the initial state, every store keeps it
+    if (first > last)
+        return;
+
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        tree_store_compact(&doc->tree_store, first, last);
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        delta_store_compact(&doc->delta_store, first, last);
+    else
+        array_compact(&doc->text_array, &doc->do_array, first, last);
+    doc->undo_floor = doc->undo_floor - (first - 1);
+    doc->version_offset = doc->version_offset + first - 1;
+
+    live = calloc(doc->arena.used_size, sizeof(unsigned char)); //rows referenced by the kept versions
+    live[EMPTY_STATE_LINE] = 1;
+    doc_for_each_line(doc, last - first + 1, doc_mark_line, live);
+    remap = malloc(doc->arena.used_size * sizeof(line_id_t));
+    line_arena_compact(&doc->arena, live, remap, !doc->options.borrow_lines);
+    doc_for_each_line(doc, last - first + 1, doc_remap_line, remap);
+    free(live);
+    free(remap);
+}
+
+int doc_compaction_due(document_t* doc)
+{
+    if (doc->options.max_undo_depth <= 0 || doc->options.borrow_lines) //borrowed rows don't move
+        return 0;
+    return doc->undo_floor >= max(doc->options.max_undo_depth, DOC_COMPACTION_MIN_VERSIONS); //a command raises the floor by one at most
+}
+
+int64_t doc_size_at(document_t* doc, int64_t version)
+{
+    doc_materialize(doc);
+    version = version - doc->version_offset;
+    if (version < doc->undo_floor || version > doc_version(doc) + doc->redo_available) //versions after the redo stack may have been overwritten
+        return 0;
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        return tree_store_size(&doc->tree_store, version);
+    if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        return delta_store_size(&doc->delta_store, version);
+    return array_version_size(&doc->text_array, &doc->do_array, version);
+}
+
+int64_t doc_size(document_t* doc)
+{
+    return doc_size_at(doc, doc_current_version(doc));
+}
+
+int64_t doc_read_range_at(document_t* doc, int64_t version, int64_t start, int64_t end, line_view_t* views)
+{
+    start = max(start, 1);
+    end = min(end, doc_size_at(doc, version));
+    if (start > end)
+        return 0;
+
+    version = version - doc->version_offset;
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        tree_store_read(&doc->tree_store, version, start, end, views);
+    else if (DOC_STORE(doc) == DOC_DELTA_STORE)
+        delta_store_read(&doc->delta_store, version, start, end, views);
+    else
+        read_text_array(&doc->text_array, &doc->do_array, &doc->arena, version, start, end, views);
+    return end - start + 1;
+}
+
+int64_t doc_read_range(document_t* doc, int64_t start, int64_t end, line_view_t* views)
+{
+    return doc_read_range_at(doc, doc_current_version(doc), start, end, views);
+}
+
+const doc_snapshot_t* doc_snapshot(document_t* doc)
+{
+    doc_snapshot_t* snapshot;
+
+    for (;;){
+        snapshot = __atomic_load_n(&doc->published, __ATOMIC_SEQ_CST);
+        if (snapshot == NULL)
+            return NULL;
+        __atomic_add_fetch(&snapshot->readers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&doc->published, __ATOMIC_SEQ_CST) == snapshot) //still published: the writer sees the count before reusing it
+            return snapshot;
+        __atomic_sub_fetch(&snapshot->readers, 1, __ATOMIC_SEQ_CST); //retired meanwhile, it may already be reused
+    }
+}
+
+void doc_snapshot_release(const doc_snapshot_t* snapshot)
+{
+    __atomic_sub_fetch(&((doc_snapshot_t*)snapshot)->readers, 1, __ATOMIC_RELEASE); //the reads of the rows come before the writer reuses it
+}
+
+int64_t doc_snapshot_version(const doc_snapshot_t* snapshot)
+{
+    return snapshot->version;
+}
+
+int64_t doc_snapshot_size(const doc_snapshot_t* snapshot)
+{
+    return snapshot->size;
+}
+
+int64_t doc_snapshot_read(document_t* doc, const doc_snapshot_t* snapshot, int64_t start, int64_t end, line_view_t* views)
+{
+    start = max(start, 1);
+    end = min(end, snapshot->size);
+    if (start > end)
+        return 0;
+
+    if (DOC_STORE(doc) == DOC_TREE_STORE)
+        tree_store_read_root(&doc->tree_store, snapshot->root, start, end, views);
+    else
+        read_text_slice(&doc->text_array, &doc->arena, snapshot->begin, start, end, views);
+    return end - start + 1;
+}
@@ -0,0 +1,242 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_DOCUMENT_H
+#define API_PROJECT_MEMENTOPATTERN_DOCUMENT_H
+
+#include <stdint.h>
+#include "line_view.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define DOC_ARRAY_STORE 0
+#define DOC_TREE_STORE 1
+#define DOC_DELTA_STORE 2
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Editor library: a document is an opaque handle holding the rows of every version and the undo/redo state, so many
+ * documents can live in the same process. Rows are numbered from 1, versions from 0 (the initial, empty, state);
+ * every change or delete creates a new version.
+ */
+typedef struct document_s document_t;
+
+/*
+ * Published version of a document: it can be read from any thread while the document keeps being modified by its
+ * writer (see concurrent_reads). A snapshot is not modified while a reader holds it, from doc_snapshot to
+ * doc_snapshot_release; then the writer can reuse it for a later version
+ */
+typedef struct doc_snapshot_s doc_snapshot_t;
+
+typedef struct doc_options_s{
+    int version_store;    // DOC_ARRAY_STORE, DOC_TREE_STORE or DOC_DELTA_STORE
+    int borrow_lines;     // if set the rows given to doc_change are referenced instead of copied, they must outlive the document
+    int concurrent_reads; // if set every command publishes a snapshot; undone rows are kept so no published row is overwritten. Not available with DOC_DELTA_STORE
+    int lazy_edits;       // if set changes/deletes are queued until the next read, the ones undone and then overwritten are never built
+    int64_t keyframe_interval; // DOC_DELTA_STORE: versions between two full copies, fewer means faster jumps but more memory
+    int intern_lines;          // if set rows with the same text are stored once and share their id
+    int64_t memory_cap;        // DOC_ARRAY_STORE: if positive, segments of old versions beyond this many bytes of versions are moved to a backing file. Not available with concurrent_reads
+    const char* spill_directory; // directory of the backing file, NULL for /tmp
+    int64_t max_undo_depth;    // if positive only the last max_undo_depth versions can be reached with undo, the older ones are compacted away. Not available with concurrent_reads
+} doc_options_t;
+
+typedef struct doc_intern_stats_s{
+    int64_t lookups;     // rows stored with intern_lines set
+    int64_t hits;        // rows whose text was already stored, hits / lookups is the hit rate
+    int64_t bytes_saved; // headers, and text of the rows that are not borrowed, not stored again
+} doc_intern_stats_t;
+
+/**
+ * Fills the options with the default values: array store, rows copied, no snapshots, edits applied at once,
+ * no interning, a keyframe every 64 versions, no memory cap, unlimited undo
+ * @param options options to fill
+ */
+void doc_default_options(doc_options_t* options);
+
+/**
+ * Creates an empty document
+ * @param options options of the document, NULL for the default ones
+ * @return the document
+ */
+document_t* doc_create(const doc_options_t* options);
+
+/**
+ * Frees a document and every row it stores
+ * @param doc document
+ */
+void doc_destroy(document_t* doc);
+
+/**
+ * Saves a DOC_ARRAY_STORE document, with all its versions and the undo/redo state, in a file that doc_load maps in
+ * memory. The file is written aside and then renamed, so a document loaded from the same path is not disturbed
+ * @param doc document, pending undo/redo and edits are carried out first
+ * @param path path of the file
+ * @return 0, -1 with errno set if the file could not be written or the document uses another store (ENOTSUP)
+ */
+int doc_save(document_t* doc, const char* path);
+
+/**
+ * Opens a document saved by doc_save. The file is mapped in memory and its pages are read only when they are needed:
+ * versions, rows and text are used in place, and new versions are added after them as usual without touching the file
+ * (the mapping is private)
+ * @param path path of the file
+ * @param options options of the document, NULL for the default ones; version_store is always DOC_ARRAY_STORE
+ * @return the document, NULL with errno set if the file can't be mapped or its header does not describe a saved document
+ * that fits in the file (EINVAL)
+ */
+document_t* doc_load(const char* path, const doc_options_t* options);
+
+/**
+ * Adds or replaces rows from start to end (command "start,endc"), start must be at most doc_size + 1
+ * @param doc document
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param lines end - start + 1 rows, newline included
+ */
+void doc_change(document_t* doc, int64_t start, int64_t end, const line_view_t* lines);
+
+/**
+ * Deletes rows from start to end (command "start,endd"), rows that do not exist are ignored
+ * @param doc document
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void doc_delete(document_t* doc, int64_t start, int64_t end);
+
+/**
+ * Undoes count changes/deletes (command "countu"). Consecutive undo/redo are summed up and carried out at the next
+ * change, delete or read
+ * @param doc document
+ * @param count number of commands to undo, limited to the ones available
+ */
+void doc_undo(document_t* doc, int64_t count);
+
+/**
+ * Redoes count undone changes/deletes (command "countr")
+ * @param doc document
+ * @param count number of commands to redo, limited to the ones available
+ */
+void doc_redo(document_t* doc, int64_t count);
+
+/**
+ * Changes the distance between keyframes of a DOC_DELTA_STORE document, it applies to the versions created from now on
+ * @param doc document
+ * @param keyframe_interval number of versions between two full copies, at least 1
+ */
+void doc_set_keyframe_interval(document_t* doc, int64_t keyframe_interval);
+
+/**
+ * Returns the counters of the rows interning (intern_lines), all 0 if it is not set
+ * @param doc document
+ * @param stats filled with the counters
+ */
+void doc_intern_stats(document_t* doc, doc_intern_stats_t* stats);
+
+/**
+ * Returns the index of the current version
+ * @param doc document
+ */
+int64_t doc_current_version(document_t* doc);
+
+/**
+ * Returns the index of the last version that can be reached with redo
+ * @param doc document
+ */
+int64_t doc_latest_version(document_t* doc);
+
+/**
+ * Returns the index of the oldest version that can be reached with undo, 0 unless max_undo_depth is set
+ * @param doc document
+ */
+int64_t doc_oldest_version(document_t* doc);
+
+/**
+ * Drops the versions older than doc_oldest_version and the ones overwritten after an undo, then frees the rows no
+ * version references anymore. Versions keep their index. It is called by the edits every time enough versions went
+ * beyond max_undo_depth, calling it directly is only needed to reclaim memory at once
+ * @param doc document
+ */
+void doc_compact(document_t* doc);
+
+/**
+ * Tells whether the next command can compact the document and free the text of the rows read so far (only when
+ * max_undo_depth is set and the rows are not borrowed): the views still in use must be consumed before it
+ * @param doc document
+ * @return 1 if the next command can compact, 0 otherwise
+ */
+int doc_compaction_due(document_t* doc);
+
+/**
+ * Returns the number of rows of a version, 0 if the version is not between doc_oldest_version and doc_latest_version
+ * @param doc document
+ * @param version index of the version
+ */
+int64_t doc_size_at(document_t* doc, int64_t version);
+
+/**
+ * Returns the number of rows of the current version
+ * @param doc document
+ */
+int64_t doc_size(document_t* doc);
+
+/**
+ * Reads rows from start to end of a version without moving the current one. Only the rows that exist are read
+ * (from max(start, 1) to min(end, doc_size_at)): the text is not copied and stays valid as long as the document,
+ * or until the next compaction when max_undo_depth is set and the rows are not borrowed
+ * @param doc document
+ * @param version index of the version
+ * @param start starting index of the range
+ * @param end ending index of the range
+ * @param views filled with the rows
+ * @return number of rows read
+ */
+int64_t doc_read_range_at(document_t* doc, int64_t version, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Reads rows from start to end of the current version, see doc_read_range_at
+ * @param doc document
+ * @param start starting index of the range
+ * @param end ending index of the range
+ * @param views filled with the rows
+ * @return number of rows read
+ */
+int64_t doc_read_range(document_t* doc, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Returns the last published snapshot, i.e. the current version after the last command, and holds it until
+ * doc_snapshot_release. It does not lock and can be called from any thread while a single writer thread modifies the
+ * document
+ * @param doc document created with concurrent_reads
+ * @return the snapshot, NULL if the document was created without concurrent_reads
+ */
+const doc_snapshot_t* doc_snapshot(document_t* doc);
+
+/**
+ * Gives back a snapshot returned by doc_snapshot, it can't be used anymore. The rows read from it stay valid as long
+ * as the document
+ * @param snapshot snapshot
+ */
+void doc_snapshot_release(const doc_snapshot_t* snapshot);
+
+/**
+ * Returns the index of the version of a snapshot
+ * @param snapshot snapshot
+ */
+int64_t doc_snapshot_version(const doc_snapshot_t* snapshot);
+
+/**
+ * Returns the number of rows of a snapshot
+ * @param snapshot snapshot
+ */
+int64_t doc_snapshot_size(const doc_snapshot_t* snapshot);
+
+/**
+ * Reads rows from start to end of a snapshot, like doc_read_range_at. It does not lock and never touches the state
+ * of the writer, so it can run on any thread
+ * @param doc document of the snapshot
+ * @param snapshot snapshot returned by doc_snapshot and not released yet
+ * @param start starting index of the range
+ * @param end ending index of the range
+ * @param views filled with the rows
+ * @return number of rows read
+ */
+int64_t doc_snapshot_read(document_t* doc, const doc_snapshot_t* snapshot, int64_t start, int64_t end, line_view_t* views);
+
+#endif //API_PROJECT_MEMENTOPATTERN_DOCUMENT_H
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "editor.h"
+#include "engine_policy.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static inline int64_t min(int64_t a, int64_t b)
+{
+    if (a<b)
+        return a;
+    return b;
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_editor(editor_t* editor, document_t* doc, int input_fd, int output_fd)
+{
+    editor->doc = doc;
+    init_input_reader(&editor->reader, input_fd); //input redirected from a file is mapped in memory
+    init_output_writer(&editor->writer, output_fd);
+    editor->lines = NULL;
+    editor->lines_size = 0;
+}
+
+void editor_print_version(editor_t* editor, int64_t version, int64_t start, int64_t end)
+{
+    int64_t document_size = doc_size_at(editor->doc, version);
+    int64_t batch_start, rows_read, i;
+
+    if (start < 1){
+        output_write_empty_lines(&editor->writer, 1 - start);
+        start = 1;
+    }
+    if (start > document_size)
+        output_write_empty_lines(&editor->writer, end - start + 1);
+    else {
+        for (batch_start = start; batch_start <= min(end, document_size); batch_start = batch_start + EDITOR_PRINT_BATCH_SIZE){
+            rows_read = doc_read_range_at(editor->doc, version, batch_start, min(batch_start + EDITOR_PRINT_BATCH_SIZE - 1, end), editor->views);
+            for (i = 0; i < rows_read; i++)
+                output_write(&editor->writer, editor->views[i].text, editor->views[i].length); //the row is only referenced, it is written at the next flush
+        }
+        output_write_empty_lines(&editor->writer, end - document_size);
+    }
+}
+
+int editor_step(editor_t* editor)
+{
+    int64_t start = 0, end = 0, version;
+    INSTR_BEGIN_COMMAND();
+    int command = input_read_command(&editor->reader, &start, &end, &version);
+    INSTR_SET_COMMAND(command);
+    if (doc_compaction_due(editor->doc)) //the rows waiting in the writer are freed by the compaction
+        output_flush(&editor->writer);
+
+    //analysis of the various cases based on command
+    if (command == EDITOR_CHANGE){
+        if (end - start + 1 > editor->lines_size){
+            editor->lines_size = end - start + 1;
+            editor->lines = realloc(editor->lines, editor->lines_size * sizeof(line_view_t));
+            INSTR_ADD(realloc_events, 1);
+        }
+        input_read_lines(&editor->reader, end - start + 1, editor->lines); //the whole block at once
+        doc_change(editor->doc, start, end, editor->lines);
+    }
+    else if (command == EDITOR_DELETE)
+        doc_delete(editor->doc, start, end);
+#if MEMENTO_POLICY_HISTORY
+    else if (command == EDITOR_UNDO) //consecutive undo/redo are summed up by the document
+        doc_undo(editor->doc, start);
+    else if (command == EDITOR_REDO)
+        doc_redo(editor->doc, start);
+#else
+    else if (command == EDITOR_UNDO || command == EDITOR_REDO){ //without history they can't be carried out: the output would be wrong
+        fprintf(stderr, "undo/redo in a stream without history, run the editor without --workload or with a workload that has undo/redo\n");
+        exit(EXIT_FAILURE);
+    }
+#endif
+    else if (command == EDITOR_PRINT)
+        editor_print_version(editor, doc_current_version(editor->doc), start, end);
+    else if (command == EDITOR_VERSION_PRINT) //"addr1,addr2vN": prints a stored version without moving the current one
+        editor_print_version(editor, version, start, end);
+    INSTR_END_COMMAND();
+    return command;
+}
+
+void free_editor(editor_t* editor)
+{
+    output_flush(&editor->writer);
+    free(editor->lines);
+    editor->lines = NULL;
+    editor->lines_size = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_EDITOR_H
+#define API_PROJECT_MEMENTOPATTERN_EDITOR_H
+
+#include <stdint.h>
+#include "document.h"
+#include "input_reader.h"
+#include "output_writer.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define EDITOR_CHANGE 'c'
+#define EDITOR_DELETE 'd'
+#define EDITOR_PRINT 'p'
+#define EDITOR_UNDO 'u'
+#define EDITOR_REDO 'r'
+#define EDITOR_QUIT 'q'
+#define EDITOR_VERSION_PRINT 'v'
+#define EDITOR_PRINT_BATCH_SIZE 4096
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Command loop of the editor: it parses the commands from the input and carries them out on a document, queueing
+ * the printed rows in the output. Shared by the editor and the benchmark, which times every step.
+ */
+typedef struct editor_s{
+    document_t* doc;
+    input_reader_t reader;
+    output_writer_t writer;
+    line_view_t* lines;   // rows of the change command being read
+    int64_t lines_size;
+    line_view_t views[EDITOR_PRINT_BATCH_SIZE];
+} editor_t;
+
+/**
+ * Initializes the editor on a document
+ * @param editor editor to initialize
+ * @param doc document the commands are carried out on
+ * @param input_fd file descriptor of the commands, mapped when it is a regular file
+ * @param output_fd file descriptor of the printed rows
+ */
+void init_editor(editor_t* editor, document_t* doc, int input_fd, int output_fd);
+
+/**
+ * Prints rows from start to end of a version of the document, rows that are not in the version are printed as "."
+ * @param editor editor
+ * @param version index of the version
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void editor_print_version(editor_t* editor, int64_t version, int64_t start, int64_t end);
+
+/**
+ * Reads the next command and carries it out
+ * @param editor editor
+ * @return the command character, INPUT_END_OF_FILE when the input is over
+ */
+int editor_step(editor_t* editor);
+
+/**
+ * Writes the rows still queued and frees the buffer of the change rows, the document is left to the caller
+ * @param editor editor
+ */
+void free_editor(editor_t* editor);
+
+#endif //API_PROJECT_MEMENTOPATTERN_EDITOR_H
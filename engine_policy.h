@@ -0,0 +1,38 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_ENGINE_POLICY_H
+#define API_PROJECT_MEMENTOPATTERN_ENGINE_POLICY_H
+
+#include "document.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define DOC_ANY_STORE (-1)
+
+/*
+ * Compile time policy of the engine. The default build decides everything at run time from the options; a variant
+ * (see add_engine_variant in CMakeLists.txt) fixes some choices with -D flags and the branches for the other cases
+ * are compiled out:
+ * - MEMENTO_POLICY_STORE: DOC_ANY_STORE, or the only version store of the variant (options.version_store is ignored);
+ * - MEMENTO_POLICY_HISTORY: 0 for streams without undo/redo. Undo never goes back (like max_undo_depth set to 0
+ *   versions): every edit after the first one is applied in place to the single version kept, instead of copying it,
+ *   and the editor stops with an error on u/r. Needs DOC_ARRAY_STORE, and turns off lazy_edits, concurrent_reads and memory_cap.
+ */
+#ifndef MEMENTO_POLICY_STORE
+#define MEMENTO_POLICY_STORE DOC_ANY_STORE
+#endif
+
+#ifndef MEMENTO_POLICY_HISTORY
+#define MEMENTO_POLICY_HISTORY 1
+#endif
+
+#if !MEMENTO_POLICY_HISTORY && MEMENTO_POLICY_STORE != DOC_ARRAY_STORE
+#error "MEMENTO_POLICY_HISTORY=0 needs MEMENTO_POLICY_STORE=DOC_ARRAY_STORE"
+#endif
+
+#define MEMENTO_POLICY_GENERIC (MEMENTO_POLICY_STORE == DOC_ANY_STORE && MEMENTO_POLICY_HISTORY)
+
+#if MEMENTO_POLICY_STORE == DOC_ANY_STORE
+#define DOC_STORE(doc) ((doc)->options.version_store)
+#else
+#define DOC_STORE(doc) MEMENTO_POLICY_STORE // constant: the compiler drops the branches of the other stores
+#endif
+
+#endif //API_PROJECT_MEMENTOPATTERN_ENGINE_POLICY_H
@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "input_reader.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define INPUT_SIMD 1
+#endif
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define INPUT_SCAN_WIDTH 32 // bytes compared at once by the widest scanner
+
+/*
+ * Scanner of the newlines of a block of rows: it looks for newlines from text + from to text + to and, for every one
+ * found, stores in ends[found].length the offset after it, until count rows are found.
+ * Returns the number of rows found, *from is moved after the last newline stored (or to to)
+ */
+typedef size_t (*input_scanner_t)(const char* text, size_t* from, size_t to, line_view_t* ends, size_t found, size_t count);
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+/**
+ * Reads the next piece of a non mapped input. When the current block is full a new one is allocated and the bytes
+ * not yet parsed are moved there, the old block is kept because rows already read point into it
+ * @param reader reader
+ */
+static void input_reader_refill(input_reader_t* reader)
+{
+    if (reader->block_end == NULL || reader->limit == reader->block_end){
+        size_t tail = reader->limit - reader->current;
+        size_t block_size = INPUT_BLOCK_SIZE;
+        if (block_size < 2 * tail)
+            block_size = 2 * tail;
+
+        char* block = (char*)malloc(sizeof(char*) + block_size) + sizeof(char*); //room for the link to the full blocks
+        if (tail > 0) //current is NULL before the first read
+            memcpy(block, reader->current, tail);
+        if (reader->block != NULL){
+            ((char**)reader->block)[-1] = reader->full_blocks;
+            reader->full_blocks = reader->block;
+        }
+        reader->block = block;
+        reader->current = block;
+        reader->limit = block + tail;
+        reader->block_end = block + block_size;
+    }
+
+    ssize_t bytes_read = read(reader->fd, (char*)reader->limit, reader->block_end - reader->limit);
+    if (bytes_read <= 0)
+        reader->end_of_file = 1;
+    else
+        reader->limit = reader->limit + bytes_read;
+}
+
+/**
+ * Makes sure that the bytes available contain a whole row (or the last one of the input)
+ * @param reader reader
+ * @return position of the newline ending the row, limit if it is the last row without newline
+ */
+static const char* input_reader_line_end(input_reader_t* reader)
+{
+    const char* newline;
+    while (reader->current == reader->limit || (newline = memchr(reader->current, '\n', reader->limit - reader->current)) == NULL){
+        if (reader->end_of_file)
+            return reader->limit;
+        input_reader_refill(reader);
+    }
+    return newline;
+}
+
+static size_t input_scan_scalar(const char* text, size_t* from, size_t to, line_view_t* ends, size_t found, size_t count)
+{
+    size_t position = *from;
+    const char* newline;
+
+    while (found < count && position < to && (newline = memchr(text + position, '\n', to - position)) != NULL){
+        position = newline - text + 1;
+        ends[found++].length = position;
+    }
+    *from = found < count ? to : position;
+    return found;
+}
+
+#ifdef INPUT_SIMD
+/**
+ * Stores the rows ending in a group of bytes, given the mask of the newlines in it
+ * @param mask bit i set if the byte at base + i is a newline
+ * @param base offset of the group
+ * @param position set after the last newline stored
+ * @return number of rows found
+ */
+static inline size_t input_store_mask(uint32_t mask, size_t base, size_t* position, line_view_t* ends, size_t found, size_t count)
+{
+    while (mask != 0 && found < count){
+        *position = base + __builtin_ctz(mask) + 1;
+        ends[found++].length = *position;
+        mask = mask & (mask - 1); //clears the lowest bit
+    }
+    return found;
+}
+
+static size_t input_scan_sse2(const char* text, size_t* from, size_t to, line_view_t* ends, size_t found, size_t count)
+{
+    const __m128i newlines = _mm_set1_epi8('\n');
+    size_t position = *from;
+    size_t base = position;
+
+    for (; found < count && base + 16 <= to; base = base + 16){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(text + base));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newlines));
+        found = input_store_mask(mask, base, &position, ends, found, count);
+    }
+    if (found < count){ //the last bytes, less than 16
+        position = base;
+        found = input_scan_scalar(text, &position, to, ends, found, count);
+    }
+    *from = position;
+    return found;
+}
+
+__attribute__((target("avx2")))
+static size_t input_scan_avx2(const char* text, size_t* from, size_t to, line_view_t* ends, size_t found, size_t count)
+{
+    const __m256i newlines = _mm256_set1_epi8('\n');
+    size_t position = *from;
+    size_t base = position;
+
+    for (; found < count && base + INPUT_SCAN_WIDTH <= to; base = base + INPUT_SCAN_WIDTH){
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(text + base));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newlines));
+        found = input_store_mask(mask, base, &position, ends, found, count);
+    }
+    if (found < count){
+        position = base;
+        found = input_scan_sse2(text, &position, to, ends, found, count);
+    }
+    *from = position;
+    return found;
+}
+#endif
+
+/**
+ * Picks the widest scanner the processor supports, the first time it is needed
+ */
+static input_scanner_t input_scanner(void)
+{
+    static input_scanner_t scanner = NULL;
+
+    if (scanner == NULL){
+#ifdef INPUT_SIMD
+        __builtin_cpu_init();
+        scanner = __builtin_cpu_supports("avx2") ? input_scan_avx2 : input_scan_sse2;
+#else
+        scanner = input_scan_scalar;
+#endif
+    }
+    return scanner;
+}
+
+static int64_t parse_number(const char** position, const char* limit)
+{
+    const char* p = *position;
+    int64_t sign = 1;
+    int64_t value = 0;
+
+    if (p < limit && *p == '-'){ //addresses such as "-1,-1d"
+        sign = -1;
+        p++;
+    }
+    while (p < limit && *p >= '0' && *p <= '9'){
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    *position = p;
+    return sign * value;
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_input_reader(input_reader_t* reader, int fd)
+{
+    struct stat file_status;
+
+    reader->fd = fd;
+    reader->current = NULL;
+    reader->limit = NULL;
+    reader->block = NULL;
+    reader->block_end = NULL;
+    reader->full_blocks = NULL;
+    reader->keep_blocks = 1;
+    reader->end_of_file = 0;
+
+    if (fstat(fd, &file_status) == 0 && S_ISREG(file_status.st_mode)){
+        if (file_status.st_size == 0){
+            reader->end_of_file = 1;
+            return;
+        }
+        char* mapped = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED){ //otherwise it falls back to the block reads
+            madvise(mapped, file_status.st_size, MADV_SEQUENTIAL);
+            reader->current = mapped;
+            reader->limit = mapped + file_status.st_size;
+            reader->end_of_file = 1; // everything is already available
+        }
+    }
+}
+
+int input_read_command(input_reader_t* reader, int64_t* start, int64_t* end, int64_t* argument)
+{
+    const char* line_end;
+    const char* p;
+    int command;
+    char* previous;
+
+    while (!reader->keep_blocks && reader->full_blocks != NULL){ //the previous commands are over: nothing points there anymore
+        previous = ((char**)reader->full_blocks)[-1];
+        free(reader->full_blocks - sizeof(char*));
+        reader->full_blocks = previous;
+    }
+    do{ //skips empty rows
+        line_end = input_reader_line_end(reader);
+        if (reader->current == reader->limit)
+            return INPUT_END_OF_FILE;
+        p = reader->current;
+        while (p < line_end && (*p == ' ' || *p == '\r' || *p == '\t'))
+            p++;
+        if (p == line_end)
+            reader->current = (line_end < reader->limit) ? line_end + 1 : line_end;
+    } while (p == line_end);
+
+    if ((*p >= '0' && *p <= '9') || *p == '-'){
+        *start = parse_number(&p, line_end);
+        if (p < line_end && *p == ','){
+            p++;
+            *end = parse_number(&p, line_end);
+        }
+    }
+    command = (p < line_end) ? (unsigned char)*p : INPUT_END_OF_FILE;
+    *argument = INPUT_NO_ARGUMENT;
+    if (p < line_end){
+        p++;
+        if (p < line_end && ((*p >= '0' && *p <= '9') || *p == '-'))
+            *argument = parse_number(&p, line_end);
+    }
+    reader->current = (line_end < reader->limit) ? line_end + 1 : line_end;
+    return command;
+}
+
+line_view_t input_read_line(input_reader_t* reader)
+{
+    const char* line_end = input_reader_line_end(reader);
+    line_view_t line;
+
+    if (line_end < reader->limit)
+        line_end++; // the newline is part of the row
+    line.text = reader->current;
+    line.length = line_end - reader->current;
+    reader->current = line_end;
+    return line;
+}
+
+void input_read_lines(input_reader_t* reader, int64_t count, line_view_t* lines)
+{
+    input_scanner_t scanner = input_scanner();
+    size_t found = 0;
+    size_t settled = 0;
+    size_t scanned = 0; // offset from reader->current of the first byte not scanned yet
+
+    if (count <= 0)
+        return;
+    for (;;){
+        size_t available = reader->limit - reader->current;
+        if (available > scanned)
+            found = scanner(reader->current, &scanned, available, lines, found, count);
+
+        size_t previous = 0;
+        for (; settled < found; settled++){ //offsets become views, before a refill can move the bytes not parsed
+            size_t line_end = lines[settled].length;
+            lines[settled].text = reader->current + previous;
+            lines[settled].length = line_end - previous;
+            previous = line_end;
+        }
+        if (previous > 0){
+            reader->current = reader->current + previous;
+            scanned = scanned - previous;
+        }
+
+        if (found == (size_t)count || reader->end_of_file)
+            break;
+        input_reader_refill(reader);
+    }
+    for (; settled < (size_t)count; settled++){ //the input is over: the last row has no newline, the missing ones are empty
+        lines[settled].text = reader->current;
+        lines[settled].length = reader->limit - reader->current;
+        reader->current = reader->limit;
+    }
+
+    const char* line_end = input_reader_line_end(reader); //the "." closing the block is skipped here
+    const char* p = reader->current;
+    if (p < line_end && *p == '.'){
+        p++;
+        while (p < line_end && (*p == ' ' || *p == '\r' || *p == '\t'))
+            p++;
+        if (p == line_end)
+            reader->current = (line_end < reader->limit) ? line_end + 1 : line_end;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_INPUT_READER_H
+#define API_PROJECT_MEMENTOPATTERN_INPUT_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line_view.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define INPUT_BLOCK_SIZE (1 << 20)
+#define INPUT_END_OF_FILE (-1)
+#define INPUT_NO_ARGUMENT (-1)
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Input of the editor. A regular file is mapped in memory as a whole; pipes and terminals are read in big blocks (a
+ * row broken between two blocks is moved to the beginning of the next one) that are kept as long as the reader when
+ * keep_blocks is set. In both cases the rows of a change command are referenced where they are, without copying them.
+ */
+typedef struct input_reader_s{
+    const char* current;  // first byte not yet parsed
+    const char* limit;    // end of the bytes available
+    char* block;          // beginning of the current block, NULL when the input is mapped
+    char* block_end;      // end of the current block, NULL when the input is mapped
+    char* full_blocks;    // blocks left behind by the refills, linked through the pointer before each of them
+    int keep_blocks;      // set by default: the rows read stay valid. Otherwise the full blocks are freed at the next command
+    int fd;
+    int end_of_file;
+} input_reader_t;
+
+/**
+ * Initializes the reader on a file descriptor, mapping it when it is a regular file
+ * @param reader reader to initialize
+ * @param fd file descriptor to read from
+ */
+void init_input_reader(input_reader_t* reader, int fd);
+
+/**
+ * Parses a command line such as "addr1,addr2c", "nu", "addr1,addr2vN" or "q". Missing addresses are left untouched.
+ * Unless keep_blocks is set, the rows read with the previous commands are no longer valid
+ * @param reader reader
+ * @param start first address of the command
+ * @param end second address of the command
+ * @param argument number following the command character, INPUT_NO_ARGUMENT if there is none
+ * @return the command character, INPUT_END_OF_FILE when the input is over
+ */
+int input_read_command(input_reader_t* reader, int64_t* start, int64_t* end, int64_t* argument);
+
+/**
+ * Reads a row of a change command, the text is referenced in place
+ * @param reader reader
+ * @return the row, newline included
+ */
+line_view_t input_read_line(input_reader_t* reader);
+
+/**
+ * Reads the whole block of rows of a change command, and the "." closing it if there is one. The newlines are found
+ * with SSE2/AVX2 comparisons when the processor has them (memchr otherwise), filling the views in one pass over the
+ * bytes; the text is referenced in place
+ * @param reader reader
+ * @param count number of rows of the block
+ * @param lines count views filled with the rows, newline included
+ */
+void input_read_lines(input_reader_t* reader, int64_t count, line_view_t* lines);
+
+#endif //API_PROJECT_MEMENTOPATTERN_INPUT_READER_H
@@ -0,0 +1,94 @@
+#include "instrumentation.h"
+
+#ifdef MEMENTO_INSTRUMENTATION
+
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+instr_counters_t instr_counters[INSTR_COMMAND_COUNT];
+__thread int instr_command = INSTR_OTHER;
+
+static const char* const instr_names[INSTR_COMMAND_COUNT] = {"change", "delete", "undo", "redo", "print", "version", "other"};
+static volatile sig_atomic_t instr_dump_requested = 0; // set by SIGUSR1, the summary is printed by the next command
+
+static void instr_signal_handler(int signal_number)
+{
+    (void)signal_number;
+    instr_dump_requested = 1; //printing is not async signal safe
+}
+
+static void instr_dump_at_exit(void)
+{
+    instr_dump(stderr);
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void instr_max(int64_t* counter, int64_t value)
+{
+    int64_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > current && !__atomic_compare_exchange_n(counter, &current, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+int64_t instr_now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+int instr_command_type(int command)
+{
+    switch (command){
+        case 'c': return INSTR_CHANGE;
+        case 'd': return INSTR_DELETE;
+        case 'u': return INSTR_UNDO;
+        case 'r': return INSTR_REDO;
+        case 'p': return INSTR_PRINT;
+        case 'v': return INSTR_VERSION_PRINT;
+        default: return INSTR_OTHER;
+    }
+}
+
+void instr_end_command(int64_t begin)
+{
+    INSTR_ADD(commands, 1);
+    INSTR_ADD(nanoseconds, instr_now() - begin);
+    instr_command = INSTR_OTHER;
+    if (instr_dump_requested){
+        instr_dump_requested = 0;
+        instr_dump(stderr);
+    }
+}
+
+void instr_install(void)
+{
+    struct sigaction action;
+
+    action.sa_handler = instr_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART; // reads of a pipe are not interrupted
+    sigaction(SIGUSR1, &action, NULL);
+    atexit(instr_dump_at_exit);
+}
+
+void instr_dump(FILE* output)
+{
+    fprintf(output, "%-8s %10s %10s %12s %12s %9s %10s %10s %12s\n", "command", "count", "time (ms)", "rows copied",
+            "bytes alloc", "reallocs", "avg rows", "max rows", "jump dist");
+    for (int i = 0; i < INSTR_COMMAND_COUNT; i++){
+        instr_counters_t* c = &instr_counters[i];
+        if (c->commands == 0 && c->lines_copied == 0 && c->bytes_allocated == 0)
+            continue;
+        fprintf(output, "%-8s %10lld %10.1f %12lld %12lld %9lld %10.1f %10lld %12lld\n", instr_names[i], (long long)c->commands,
+                c->nanoseconds / 1e6, (long long)c->lines_copied, (long long)c->bytes_allocated, (long long)c->realloc_events,
+                c->versions_built > 0 ? (double)c->version_rows / c->versions_built : 0.0, (long long)c->max_version_rows, (long long)c->jump_distance);
+    }
+    fflush(output);
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_INSTRUMENTATION_H
+#define API_PROJECT_MEMENTOPATTERN_INSTRUMENTATION_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define INSTR_CHANGE 0
+#define INSTR_DELETE 1
+#define INSTR_UNDO 2
+#define INSTR_REDO 3
+#define INSTR_PRINT 4
+#define INSTR_VERSION_PRINT 5
+#define INSTR_OTHER 6 // work done outside the editor loop (e.g. by the document server), and other commands
+#define INSTR_COMMAND_COUNT 7
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Counters of the work done by every type of command, built only with -DMEMENTO_INSTRUMENTATION=ON: otherwise every
+ * macro expands to nothing and the hot paths are unchanged. The work is charged to the command the editor is
+ * carrying out on the same thread, so the cost of a pending undo/redo shows up in the command that applies it.
+ * The summary is printed on stderr at exit and whenever the process gets SIGUSR1.
+ */
+#ifdef MEMENTO_INSTRUMENTATION
+
+typedef struct instr_counters_s{
+    int64_t commands;
+    int64_t nanoseconds;      // time spent in the editor loop, parsing included
+    int64_t lines_copied;     // row ids written in the history: cells of the text array, tree nodes, entries of the delta log
+    int64_t bytes_allocated;  // segments, directories, arena chunks, node pools and grown buffers
+    int64_t realloc_events;   // buffers and directories that had to grow
+    int64_t versions_built;   // versions created, with --lazy by the prints that build the queued edits
+    int64_t version_rows;     // rows of the versions created, version_rows / versions_built is the average size
+    int64_t max_version_rows;
+    int64_t jump_distance;    // versions crossed by the undo/redo jumps applied
+} instr_counters_t;
+
+extern instr_counters_t instr_counters[INSTR_COMMAND_COUNT];
+extern __thread int instr_command; // command the counters of this thread are charged to
+
+#define INSTR_ADD(field, amount) __atomic_fetch_add(&instr_counters[instr_command].field, (int64_t)(amount), __ATOMIC_RELAXED)
+#define INSTR_MAX(field, value) instr_max(&instr_counters[instr_command].field, (int64_t)(value))
+#define INSTR_BEGIN_COMMAND() int64_t instr_begin = instr_now()
+#define INSTR_SET_COMMAND(command) (instr_command = instr_command_type(command))
+#define INSTR_END_COMMAND() instr_end_command(instr_begin)
+#define INSTR_INSTALL() instr_install()
+
+/**
+ * Raises a counter to value if it is lower
+ * @param counter counter
+ * @param value new value
+ */
+void instr_max(int64_t* counter, int64_t value);
+
+/**
+ * Returns the monotonic clock in nanoseconds
+ */
+int64_t instr_now(void);
+
+/**
+ * Maps a command character of the editor to its counters, INSTR_OTHER if it has none
+ * @param command command character
+ */
+int instr_command_type(int command);
+
+/**
+ * Charges a command and its time to the current counters, then prints the summary if SIGUSR1 arrived meanwhile
+ * @param begin instr_now() when the command started
+ */
+void instr_end_command(int64_t begin);
+
+/**
+ * Prints the summary at exit and on SIGUSR1
+ */
+void instr_install(void);
+
+/**
+ * Prints a row of counters for every type of command
+ * @param output file to print to
+ */
+void instr_dump(FILE* output);
+
+#else
+
+#define INSTR_ADD(field, amount) ((void)0)
+#define INSTR_MAX(field, value) ((void)0)
+#define INSTR_BEGIN_COMMAND() ((void)0)
+#define INSTR_SET_COMMAND(command) ((void)0)
+#define INSTR_END_COMMAND() ((void)0)
+#define INSTR_INSTALL() ((void)0)
+
+#endif
+
+#endif //API_PROJECT_MEMENTOPATTERN_INSTRUMENTATION_H
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "line_arena.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+/**
+ * Makes sure that at least size bytes are available in the current chunk, otherwise a new chunk is allocated.
+ * The remaining space of the old chunk is left unused
+ * @param arena arena
+ * @param size bytes needed
+ */
+static void line_arena_reserve(line_arena_t* arena, size_t size)
+{
+    if (arena->current != NULL && (size_t)(arena->limit - arena->current) >= size)
+        return;
+
+    size_t chunk_size = LINE_ARENA_CHUNK_SIZE;
+    if (chunk_size < size + sizeof(line_arena_chunk_t))
+        chunk_size = size + sizeof(line_arena_chunk_t);
+
+    line_arena_chunk_t* chunk = malloc(chunk_size);
+    INSTR_ADD(bytes_allocated, chunk_size);
+    chunk->previous = arena->chunks;
+    arena->chunks = chunk;
+    arena->current = (char*)(chunk + 1);
+    arena->limit = (char*)chunk + chunk_size;
+}
+
+/**
+ * FNV-1a hash of the text of a row
+ * @param text bytes of the row
+ * @param length number of bytes
+ */
+static uint32_t line_hash(const char* text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++){
+        hash = hash ^ (unsigned char)text[i];
+        hash = hash * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Doubles the interning table, slots keep their hash so the text is not read again
+ * @param arena arena
+ */
+static void line_intern_grow(line_arena_t* arena)
+{
+    size_t old_size = arena->intern_mask + 1;
+    line_intern_slot_t* old_table = arena->intern_table;
+
+    arena->intern_mask = 2 * old_size - 1;
+    arena->intern_table = calloc(2 * old_size, sizeof(line_intern_slot_t));
+    INSTR_ADD(realloc_events, 1);
+    INSTR_ADD(bytes_allocated, 2 * old_size * sizeof(line_intern_slot_t));
+    for (size_t i = 0; i < old_size; i++){
+        if (old_table[i].id == EMPTY_STATE_LINE)
+            continue;
+        size_t slot = old_table[i].hash & arena->intern_mask;
+        while (arena->intern_table[slot].id != EMPTY_STATE_LINE)
+            slot = (slot + 1) & arena->intern_mask;
+        arena->intern_table[slot] = old_table[i];
+    }
+    free(old_table);
+}
+
+/**
+ * Looks a row up in the interning table and stores it if it is not there
+ * @param arena arena, interning must be enabled
+ * @param text bytes of the row
+ * @param length number of bytes
+ * @param copy_bytes if set the bytes of a new row are copied in the arena
+ * @param hit set to 1 if the row was already stored, 0 otherwise
+ * @return the id of the row
+ */
+static line_id_t line_intern(line_arena_t* arena, const char* text, size_t length, int copy_bytes, int* hit)
+{
+    uint32_t hash = line_hash(text, length);
+    size_t slot = hash & arena->intern_mask;
+
+    while (arena->intern_table[slot].id != EMPTY_STATE_LINE){ //linear probing, the table is at most half full
+        if (arena->intern_table[slot].hash == hash){
+            line_t line = line_arena_get(arena, arena->intern_table[slot].id);
+            if (line.length == length && memcmp(line.text, text, length) == 0){
+                *hit = 1;
+                return arena->intern_table[slot].id;
+            }
+        }
+        slot = (slot + 1) & arena->intern_mask;
+    }
+
+    *hit = 0;
+    line_id_t id = copy_bytes ? line_arena_store_line(arena, text, length) : line_arena_new_line(arena, text, length);
+    arena->intern_table[slot].id = id;
+    arena->intern_table[slot].hash = hash;
+    arena->intern_used_size++;
+    if (2 * arena->intern_used_size > arena->intern_mask + 1)
+        line_intern_grow(arena);
+    return id;
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_line_arena(line_arena_t* arena)
+{
+    init_segmented_array(&arena->lines, sizeof(line_t));
+    arena->used_size = 0;
+    arena->current = NULL;
+    arena->limit = NULL;
+    arena->chunks = NULL;
+    arena->intern_table = NULL;
+    arena->intern_mask = 0;
+    arena->intern_used_size = 0;
+    arena->intern_stats.lookups = 0;
+    arena->intern_stats.hits = 0;
+    arena->intern_stats.bytes_saved = 0;
+    arena->mapped_slots = NULL;
+    arena->mapped_bytes = NULL;
+    arena->mapped_size = 0;
+    line_arena_new_line(arena, EMPTY_STATE, sizeof(EMPTY_STATE) - 1); // gets EMPTY_STATE_LINE as id
+}
+
+void line_arena_attach(line_arena_t* arena, const line_slot_t* slots, const char* bytes, line_id_t count)
+{
+    init_line_arena(arena);
+    arena->used_size = count; //replaces the empty state row just stored, the saved one has the same id
+    arena->mapped_slots = slots;
+    arena->mapped_bytes = bytes;
+    arena->mapped_size = count;
+}
+
+line_id_t line_arena_new_line(line_arena_t* arena, const char* text, size_t length)
+{
+    if (arena->used_size == LINE_ARENA_MAX_LINES){ //ids are 32 bit: wrapping around would give the id of a stored row again
+        fprintf(stderr, "line arena: %lu rows stored, no row id is left\n", (unsigned long)LINE_ARENA_MAX_LINES);
+        abort();
+    }
+    if (arena->used_size - arena->mapped_size == arena->lines.max_size)
+        segmented_array_grow(&arena->lines);
+
+    line_t* line = (line_t*)segmented_array_at(&arena->lines, arena->used_size - arena->mapped_size);
+    line->text = text;
+    line->length = length;
+    return arena->used_size++;
+}
+
+line_id_t line_arena_store_line(line_arena_t* arena, const char* text, size_t length)
+{
+    line_arena_reserve(arena, length);
+    char* copy = arena->current;
+    memcpy(copy, text, length);
+    arena->current = arena->current + length; // rows are not null terminated, no alignment needed
+    return line_arena_new_line(arena, copy, length);
+}
+
+void line_arena_enable_interning(line_arena_t* arena)
+{
+    if (arena->intern_table != NULL)
+        return;
+    arena->intern_table = calloc(LINE_INTERN_INITIAL_SIZE, sizeof(line_intern_slot_t));
+    arena->intern_mask = LINE_INTERN_INITIAL_SIZE - 1;
+    arena->intern_used_size = 0;
+}
+
+line_id_t line_arena_intern_line(line_arena_t* arena, const char* text, size_t length, int copy_bytes)
+{
+    int hit;
+    line_id_t id;
+
+    if (arena->intern_table == NULL)
+        return copy_bytes ? line_arena_store_line(arena, text, length) : line_arena_new_line(arena, text, length);
+
+    id = line_intern(arena, text, length, copy_bytes, &hit);
+    arena->intern_stats.lookups++;
+    if (hit){
+        arena->intern_stats.hits++;
+        arena->intern_stats.bytes_saved = arena->intern_stats.bytes_saved + sizeof(line_t) + (copy_bytes ? length : 0);
+    }
+    return id;
+}
+
+void line_arena_compact(line_arena_t* arena, const unsigned char* live, line_id_t* remap, int copy_bytes)
+{
+    line_arena_t compacted;
+
+    int hit;
+
+    init_line_arena(&compacted); // the empty state row keeps its id
+    if (arena->intern_table != NULL){ //the table is rebuilt with the new ids, the counters go on
+        line_arena_enable_interning(&compacted);
+        compacted.intern_stats = arena->intern_stats;
+    }
+    remap[EMPTY_STATE_LINE] = EMPTY_STATE_LINE;
+    for (line_id_t id = EMPTY_STATE_LINE + 1; id < arena->used_size; id++){
+        if (!live[id])
+            continue;
+        line_t line = line_arena_get(arena, id);
+        if (compacted.intern_table != NULL)
+            remap[id] = line_intern(&compacted, line.text, line.length, copy_bytes, &hit);
+        else if (copy_bytes) //the old chunks are freed below
+            remap[id] = line_arena_store_line(&compacted, line.text, line.length);
+        else //the text stays where it is, in the input or in a mapped file
+            remap[id] = line_arena_new_line(&compacted, line.text, line.length);
+    }
+    free_line_arena(arena);
+    *arena = compacted;
+}
+
+void free_line_arena(line_arena_t* arena)
+{
+    line_arena_chunk_t* previous;
+    while (arena->chunks != NULL){
+        previous = arena->chunks->previous;
+        free(arena->chunks);
+        arena->chunks = previous;
+    }
+    free_segmented_array(&arena->lines);
+    free(arena->intern_table);
+    arena->intern_table = NULL;
+    arena->current = NULL;
+    arena->limit = NULL;
+    arena->used_size = 0;
+    arena->mapped_size = 0;
+}
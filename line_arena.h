@@ -0,0 +1,155 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_LINE_ARENA_H
+#define API_PROJECT_MEMENTOPATTERN_LINE_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line_view.h"
+#include "segmented_array.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define EMPTY_STATE ".\n"
+#define EMPTY_STATE_LINE 0 // id of the row used for the "empty state", stored when the arena is initialized
+#define LINE_ARENA_CHUNK_SIZE (1 << 20)
+#define LINE_INTERN_INITIAL_SIZE 1024 // slots of the interning table, a power of 2
+#define LINE_ARENA_MAX_LINES UINT32_MAX // ids available, doc_compact gives back the ids of the rows no longer used
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Rows are stored once and then only referenced, the versions copy the 32 bit id of the line_t.
+ */
+typedef line_view_t line_t;
+
+typedef uint32_t line_id_t;
+
+typedef void (*line_visit_t)(line_id_t* line, void* context); // called on every row id stored by a version store
+
+typedef struct line_arena_chunk_s{
+    struct line_arena_chunk_s* previous;
+} line_arena_chunk_t;
+
+typedef struct line_slot_s{
+    uint64_t offset; // position of the text in the bytes of a saved document
+    uint64_t length;
+} line_slot_t;
+
+typedef struct line_intern_slot_s{
+    line_id_t id;   // EMPTY_STATE_LINE if the slot is free, the empty state row is never interned
+    uint32_t hash;
+} line_intern_slot_t;
+
+typedef struct line_intern_stats_s{
+    uint64_t lookups;     // rows given to line_arena_intern_line
+    uint64_t hits;        // rows whose text was already stored
+    uint64_t bytes_saved; // bytes of the headers, and of the text when it is copied, not stored again thanks to the hits
+} line_intern_stats_t;
+
+/*
+ * Bump allocator for the rows: line_t headers are stored one after the other in the segments of a segmented array
+ * and they are never freed one by one, since every row can be referenced by some version of the history.
+ * The id of a row is its index: 32 bits in the versions, resolved through the 64 bit directory of segments.
+ * Rows whose bytes are not owned by someone else (e.g. the input buffer) are copied in big byte chunks.
+ * With interning a hash table keyed by the text finds the rows already stored, so a text rewritten many times (a
+ * replacement applied again, a revert) has one header, one copy of its bytes and one id shared by the versions.
+ * The first rows can come from a mapped file (line_arena_attach): they are resolved through its table of offsets and
+ * never copied, the rows added later go in the headers as usual.
+ */
+typedef struct line_arena_s{
+    segmented_array_t lines; // of line_t
+    line_id_t used_size;
+    char* current;           // free bytes of the current chunk
+    char* limit;
+    line_arena_chunk_t* chunks;
+
+    line_intern_slot_t* intern_table; // open addressing table of the rows keyed by their text, NULL if rows are not interned
+    size_t intern_mask;               // number of slots - 1
+    size_t intern_used_size;
+    line_intern_stats_t intern_stats;
+
+    const line_slot_t* mapped_slots;  // rows from 0 to mapped_size - 1, their text is at mapped_bytes + offset
+    const char* mapped_bytes;
+    line_id_t mapped_size;
+} line_arena_t;
+
+/**
+ * Initializes the arena with the empty state row
+ * @param arena arena to initialize
+ */
+void init_line_arena(line_arena_t* arena);
+
+/**
+ * Initializes the arena with the rows of a saved document, which are referenced in place
+ * @param arena arena to initialize
+ * @param slots offset and length of every row, the first one is the empty state row
+ * @param bytes text of the rows
+ * @param count number of rows, at least 1
+ */
+void line_arena_attach(line_arena_t* arena, const line_slot_t* slots, const char* bytes, line_id_t count);
+
+/**
+ * Stores the header of a row whose bytes are kept elsewhere (e.g. in the input buffer)
+ * @param arena arena in which the header is allocated
+ * @param text bytes of the row, newline included
+ * @param length number of bytes
+ * @return the id of the stored row, the process is aborted once the LINE_ARENA_MAX_LINES ids are all used
+ */
+line_id_t line_arena_new_line(line_arena_t* arena, const char* text, size_t length);
+
+/**
+ * Copies the bytes of a row in the arena and stores its header
+ * @param arena arena in which the row is stored
+ * @param text bytes of the row, newline included
+ * @param length number of bytes
+ * @return the id of the stored row
+ */
+line_id_t line_arena_store_line(line_arena_t* arena, const char* text, size_t length);
+
+/**
+ * Turns on interning: from now on line_arena_intern_line returns the same id for rows with the same text
+ * @param arena arena, the rows already stored are not interned
+ */
+void line_arena_enable_interning(line_arena_t* arena);
+
+/**
+ * Returns the id of a row with the same text if it is already stored, otherwise stores it. Without interning it is
+ * the same as line_arena_new_line/line_arena_store_line
+ * @param arena arena in which the row is stored
+ * @param text bytes of the row, newline included
+ * @param length number of bytes
+ * @param copy_bytes if set the bytes of a new row are copied in the arena (line_arena_store_line)
+ * @return the id of the row
+ */
+line_id_t line_arena_intern_line(line_arena_t* arena, const char* text, size_t length, int copy_bytes);
+
+/**
+ * Keeps only the rows marked as live, renumbered from EMPTY_STATE_LINE on in the same order, and frees the others
+ * @param arena arena to compact
+ * @param live one flag per id, EMPTY_STATE_LINE is always kept
+ * @param remap filled with the new id of every live row, rows with the same text get the same id if the arena interns
+ * them
+ * @param copy_bytes if set the bytes of the rows belong to the arena and are copied in new chunks, otherwise only
+ * the headers are moved
+ */
+void line_arena_compact(line_arena_t* arena, const unsigned char* live, line_id_t* remap, int copy_bytes);
+
+/**
+ * Frees the headers and the bytes copied in the arena
+ * @param arena arena to free
+ */
+void free_line_arena(line_arena_t* arena);
+
+/**
+ * Returns the row with a given id
+ * @param arena arena
+ * @param id id of the row
+ */
+static inline line_t line_arena_get(line_arena_t* arena, line_id_t id)
+{
+    if (id < arena->mapped_size){ //row of a loaded document
+        line_t line = {arena->mapped_bytes + arena->mapped_slots[id].offset, arena->mapped_slots[id].length};
+        return line;
+    }
+    return *(line_t*)segmented_array_at(&arena->lines, id - arena->mapped_size);
+}
+
+#endif //API_PROJECT_MEMENTOPATTERN_LINE_ARENA_H
@@ -0,0 +1,14 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_LINE_VIEW_H
+#define API_PROJECT_MEMENTOPATTERN_LINE_VIEW_H
+
+#include <stddef.h>
+
+/*
+ * A row of the document: the text (newline included, not null terminated) and its length.
+ */
+typedef struct line_view_s{
+    const char* text;
+    size_t length;
+} line_view_t;
+
+#endif //API_PROJECT_MEMENTOPATTERN_LINE_VIEW_H
@@ -0,0 +1,72 @@
+#include <errno.h>
+#include <unistd.h>
+#include "output_writer.h"
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static char empty_lines[2 * OUTPUT_EMPTY_LINES_BLOCK]; // ".\n" repeated, shared by every run of empty rows
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_output_writer(output_writer_t* writer, int fd)
+{
+    writer->used_size = 0;
+    writer->fd = fd;
+    if (empty_lines[0] == 0){
+        for (int i = 0; i < OUTPUT_EMPTY_LINES_BLOCK; i++){
+            empty_lines[2*i] = '.';
+            empty_lines[2*i+1] = '\n';
+        }
+    }
+}
+
+void output_write(output_writer_t* writer, const char* text, size_t length)
+{
+    if (writer->used_size > 0){
+        struct iovec* last = &writer->iovec[writer->used_size-1];
+        if ((const char*)last->iov_base + last->iov_len == text){ //contiguous rows (e.g. untouched rows of a mapped input) share the iovec
+            last->iov_len = last->iov_len + length;
+            return;
+        }
+    }
+    if (writer->used_size == OUTPUT_IOVEC_SIZE)
+        output_flush(writer);
+    writer->iovec[writer->used_size].iov_base = (void*)text;
+    writer->iovec[writer->used_size].iov_len = length;
+    writer->used_size++;
+}
+
+void output_write_empty_lines(output_writer_t* writer, long count)
+{
+    while (count > OUTPUT_EMPTY_LINES_BLOCK){
+        output_write(writer, empty_lines, sizeof(empty_lines));
+        count = count - OUTPUT_EMPTY_LINES_BLOCK;
+    }
+    if (count > 0)
+        output_write(writer, empty_lines, 2 * count);
+}
+
+void output_flush(output_writer_t* writer)
+{
+    struct iovec* iovec = writer->iovec;
+    int count = writer->used_size;
+
+    while (count > 0){
+        ssize_t written = writev(writer->fd, iovec, count);
+        if (written < 0){
+            if (errno == EINTR)
+                continue;
+            break; //nothing more can be done, e.g. the reader closed the pipe
+        }
+        while (count > 0 && (size_t)written >= iovec->iov_len){ //skips what has been written, partial writes are resumed
+            written = written - iovec->iov_len;
+            iovec++;
+            count--;
+        }
+        if (count > 0){
+            iovec->iov_base = (char*)iovec->iov_base + written;
+            iovec->iov_len = iovec->iov_len - written;
+        }
+    }
+    writer->used_size = 0;
+}
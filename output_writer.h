@@ -0,0 +1,52 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_OUTPUT_WRITER_H
+#define API_PROJECT_MEMENTOPATTERN_OUTPUT_WRITER_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define OUTPUT_IOVEC_SIZE 1024
+#define OUTPUT_EMPTY_LINES_BLOCK 2048
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Output of the editor. Printed rows are not copied: the writer collects an iovec pointing to the stored rows (they
+ * are never modified nor freed) and writes them with a single writev when the list is full or at the end.
+ * Rows that are contiguous in memory are merged in the same iovec.
+ */
+typedef struct output_writer_s{
+    struct iovec iovec[OUTPUT_IOVEC_SIZE];
+    int used_size;
+    int fd;
+} output_writer_t;
+
+/**
+ * Initializes the writer on a file descriptor
+ * @param writer writer to initialize
+ * @param fd file descriptor to write to
+ */
+void init_output_writer(output_writer_t* writer, int fd);
+
+/**
+ * Queues bytes that will stay valid until the writer is flushed
+ * @param writer writer
+ * @param text bytes to write
+ * @param length number of bytes
+ */
+void output_write(output_writer_t* writer, const char* text, size_t length);
+
+/**
+ * Queues a run of empty rows (".\n")
+ * @param writer writer
+ * @param count number of empty rows
+ */
+void output_write_empty_lines(output_writer_t* writer, long count);
+
+/**
+ * Writes everything that has been queued
+ * @param writer writer
+ */
+void output_flush(output_writer_t* writer);
+
+#endif //API_PROJECT_MEMENTOPATTERN_OUTPUT_WRITER_H
@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include "persistent_tree.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static unsigned int tree_random(tree_store_t* store)
+{
+    store->random_state ^= store->random_state << 13; // xorshift32, priorities only need to be well spread
+    store->random_state ^= store->random_state >> 17;
+    store->random_state ^= store->random_state << 5;
+    return store->random_state;
+}
+
+static int64_t min_index(int64_t a, int64_t b)
+{
+    if (a < b)
+        return a;
+    return b;
+}
+
+static int64_t max_index(int64_t a, int64_t b)
+{
+    if (a > b)
+        return a;
+    return b;
+}
+
+static int64_t tree_size(tree_node_t* node)
+{
+    if (node == NULL)
+        return 0;
+    return node->size;
+}
+
+static void tree_update(tree_node_t* node)
+{
+    node->size = tree_size(node->left) + tree_size(node->right) + 1;
+}
+
+static tree_node_t* tree_node_alloc(tree_store_t* store)
+{
+    if (store->pool == NULL || store->pool->used_size == TREE_NODE_POOL_SIZE){ // nodes are never freed: they are taken from big blocks
+        tree_node_pool_t* pool = malloc(sizeof(tree_node_pool_t));
+        pool->nodes = malloc(TREE_NODE_POOL_SIZE * sizeof(tree_node_t));
+        pool->used_size = 0;
+        pool->previous = store->pool;
+        store->pool = pool;
+        INSTR_ADD(bytes_allocated, sizeof(tree_node_pool_t) + TREE_NODE_POOL_SIZE * sizeof(tree_node_t));
+    }
+    INSTR_ADD(lines_copied, 1);
+    return &store->pool->nodes[store->pool->used_size++];
+}
+
+static tree_node_t* tree_node_copy(tree_store_t* store, tree_node_t* node)
+{
+    tree_node_t* copy = tree_node_alloc(store);
+    *copy = *node;
+    return copy;
+}
+
+/* ------------------------------------------------------------------------------------------ persistent operations ------------------------------------------------------------------------------------------ */
+
+/**
+ * Splits a tree in the first k rows and the remaining ones, copying only the nodes on the split path
+ * @param store tree store
+ * @param node root of the tree to split
+ * @param k number of rows that go in the left tree
+ * @param left resulting left tree
+ * @param right resulting right tree
+ */
+static void tree_split(tree_store_t* store, tree_node_t* node, int64_t k, tree_node_t** left, tree_node_t** right)
+{
+    if (k <= 0){ //nothing goes on the left: the whole subtree is shared
+        *left = NULL;
+        *right = node;
+        return;
+    }
+    if (k >= tree_size(node)){ //everything goes on the left: the whole subtree is shared
+        *left = node;
+        *right = NULL;
+        return;
+    }
+
+    tree_node_t* copy = tree_node_copy(store, node);
+    if (tree_size(node->left) < k){
+        tree_split(store, node->right, k - tree_size(node->left) - 1, &copy->right, right);
+        tree_update(copy);
+        *left = copy;
+    } else {
+        tree_split(store, node->left, k, left, &copy->left);
+        tree_update(copy);
+        *right = copy;
+    }
+}
+
+/**
+ * Concatenates two trees, copying only the nodes on the merge path
+ * @param store tree store
+ * @param left tree whose rows come first
+ * @param right tree whose rows come after
+ * @return root of the concatenation
+ */
+static tree_node_t* tree_merge(tree_store_t* store, tree_node_t* left, tree_node_t* right)
+{
+    tree_node_t* copy;
+
+    if (left == NULL)
+        return right;
+    if (right == NULL)
+        return left;
+
+    if (left->priority > right->priority){
+        copy = tree_node_copy(store, left);
+        copy->right = tree_merge(store, left->right, right);
+    } else {
+        copy = tree_node_copy(store, right);
+        copy->left = tree_merge(store, left, right->left);
+    }
+    tree_update(copy);
+    return copy;
+}
+
+/**
+ * Appends a node at the end of a tree that is not yet part of any version, so it can be modified in place
+ * @param tree root of the pending tree
+ * @param node node to append
+ * @return root of the pending tree
+ */
+static tree_node_t* tree_append_in_place(tree_node_t* tree, tree_node_t* node)
+{
+    if (tree == NULL)
+        return node;
+    if (node->priority > tree->priority){
+        node->left = tree;
+        tree_update(node);
+        return node;
+    }
+    tree->right = tree_append_in_place(tree->right, node);
+    tree_update(tree);
+    return tree;
+}
+
+/**
+ * Copies a subtree in the current pool. A copied node is marked with a negative size and its left child points to
+ * the copy, so shared subtrees are copied only once
+ * @param store tree store
+ * @param node root of the subtree to copy, in the old pools
+ * @return root of the copy
+ */
+static tree_node_t* tree_copy(tree_store_t* store, tree_node_t* node)
+{
+    if (node == NULL)
+        return NULL;
+    if (node->size < 0) //already copied: the old node is only a forward
+        return node->left;
+
+    tree_node_t* copy = tree_node_copy(store, node);
+    node->size = -1;
+    node->left = copy;
+    copy->left = tree_copy(store, copy->left);
+    copy->right = tree_copy(store, copy->right);
+    return copy;
+}
+
+static void tree_free_pools(tree_node_pool_t* pool)
+{
+    tree_node_pool_t* previous;
+    while (pool != NULL){
+        previous = pool->previous;
+        free(pool->nodes);
+        free(pool);
+        pool = previous;
+    }
+}
+
+static void tree_store_add_version(tree_store_t* store, tree_node_t* root)
+{
+    if (store->used_size + 1 == store->max_size){
+        store->max_size *= 2;
+        store->versions = realloc(store->versions, store->max_size * sizeof(tree_node_t*));
+        INSTR_ADD(realloc_events, 1);
+        INSTR_ADD(bytes_allocated, store->max_size * sizeof(tree_node_t*));
+    }
+    store->used_size++;
+    store->versions[store->used_size] = root;
+}
+
+/**
+ * Reads the rows from start to end (0 based, relative to the subtree) in order
+ * @param store tree store
+ * @param node root of the subtree
+ * @param start first row to read
+ * @param end last row to read
+ * @param views views filled with the rows, views[0] is the row start
+ */
+static void tree_read_range(tree_store_t* store, tree_node_t* node, int64_t start, int64_t end, line_view_t* views)
+{
+    if (node == NULL || start > end)
+        return;
+
+    int64_t left_size = tree_size(node->left);
+    if (start < left_size)
+        tree_read_range(store, node->left, start, min_index(end, left_size - 1), views);
+    if (start <= left_size && left_size <= end)
+        views[left_size - start] = line_arena_get(store->arena, node->text_line);
+    if (end > left_size)
+        tree_read_range(store, node->right, max_index(start - left_size - 1, 0), end - left_size - 1, views + max_index(left_size + 1 - start, 0));
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_tree_store(tree_store_t* store, line_arena_t* arena, size_t initial_size)
+{
+    store->versions = malloc(initial_size * sizeof(tree_node_t*));
+    store->used_size = 0;
+    store->versions[0] = NULL; // initial state is the empty tree
+    store->max_size = initial_size;
+    store->pending = NULL;
+    store->pool = NULL;
+    store->arena = arena;
+    store->random_state = 2463534242u;
+}
+
+int64_t tree_store_size(tree_store_t* store, int64_t version)
+{
+    return tree_size(store->versions[version]);
+}
+
+void tree_store_push_line(tree_store_t* store, line_id_t text_line)
+{
+    tree_node_t* node = tree_node_alloc(store);
+    node->left = NULL;
+    node->right = NULL;
+    node->text_line = text_line;
+    node->priority = tree_random(store);
+    node->size = 1;
+    store->pending = tree_append_in_place(store->pending, node);
+}
+
+void tree_store_change(tree_store_t* store, int64_t start, int64_t end)
+{
+    tree_node_t* left;
+    tree_node_t* rest;
+    tree_node_t* replaced;
+    tree_node_t* right;
+
+    tree_split(store, store->versions[store->used_size], start - 1, &left, &rest);
+    tree_split(store, rest, end - start + 1, &replaced, &right); // replaced rows stay reachable from the older versions only
+    tree_store_add_version(store, tree_merge(store, tree_merge(store, left, store->pending), right));
+    store->pending = NULL;
+}
+
+void tree_store_delete(tree_store_t* store, int64_t start, int64_t end)
+{
+    tree_node_t* current = store->versions[store->used_size];
+    tree_node_t* left;
+    tree_node_t* rest;
+    tree_node_t* deleted;
+    tree_node_t* right;
+    int64_t size = tree_size(current);
+
+    if (end < 1 || start > size){ //there are no deletions: the new version shares the previous root
+        tree_store_add_version(store, current);
+        return;
+    }
+
+    start = max_index(1, start);
+    end = min_index(end, size);
+    tree_split(store, current, start - 1, &left, &rest);
+    tree_split(store, rest, end - start + 1, &deleted, &right);
+    tree_store_add_version(store, tree_merge(store, left, right));
+}
+
+void tree_store_read(tree_store_t* store, int64_t version, int64_t start, int64_t end, line_view_t* views)
+{
+    tree_store_read_root(store, store->versions[version], start, end, views);
+}
+
+void tree_store_read_root(tree_store_t* store, tree_node_t* root, int64_t start, int64_t end, line_view_t* views)
+{
+    tree_read_range(store, root, start - 1, end - 1, views);
+}
+
+void tree_store_compact(tree_store_t* store, int64_t first, int64_t last)
+{
+    tree_node_pool_t* old_pool = store->pool;
+
+    store->pool = NULL; //the copies go in new pools
+    for (int64_t version = first; version <= last; version++)
+        store->versions[version - first + 1] = tree_copy(store, store->versions[version]);
+    tree_free_pools(old_pool);
+    store->used_size = store->used_size - (first - 1);
+}
+
+void tree_store_for_each_line(tree_store_t* store, line_visit_t visit, void* context)
+{
+    for (tree_node_pool_t* pool = store->pool; pool != NULL; pool = pool->previous){
+        for (int i = 0; i < pool->used_size; i++)
+            visit(&pool->nodes[i].text_line, context);
+    }
+}
+
+void free_tree_store(tree_store_t* store)
+{
+    tree_free_pools(store->pool);
+    store->pool = NULL;
+    free(store->versions);
+    store->versions = NULL;
+}
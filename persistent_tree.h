@@ -0,0 +1,128 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_PERSISTENT_TREE_H
+#define API_PROJECT_MEMENTOPATTERN_PERSISTENT_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line_arena.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define TREE_STORE_INITIAL_VERSIONS 1024
+#define TREE_NODE_POOL_SIZE 65536
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Persistent implicit treap: every node holds one row of the document, the position of a row is given by the
+ * size of the subtrees on its left. Nodes are never modified once they are reachable from a version: changes copy
+ * only the nodes on the path they touch, so every old version stays reachable from its own root.
+ */
+typedef struct tree_node_s{
+    struct tree_node_s* left;
+    struct tree_node_s* right;
+    line_id_t text_line;
+    unsigned int priority;
+    int64_t size;
+} tree_node_t;
+
+typedef struct tree_node_pool_s{
+    tree_node_t* nodes;
+    int used_size;
+    struct tree_node_pool_s* previous;
+} tree_node_pool_t;
+
+typedef struct tree_store_s{
+    tree_node_t** versions; // versions[0] is the initial (empty) state
+    int64_t used_size;      // index of the current version, same meaning as do_array->used_size
+    int64_t max_size;
+    tree_node_t* pending;   // rows of the change command being read, not yet part of any version
+    tree_node_pool_t* pool;
+    line_arena_t* arena;    // rows referenced by the nodes
+    unsigned int random_state; // per store, so documents modified on different threads do not share it
+} tree_store_t;
+
+/**
+ * Initializes the persistent tree store with the empty initial version
+ * @param store store to allocate
+ * @param arena arena in which the rows are stored
+ * @param initial_size number of versions to initialize the store with
+ */
+void init_tree_store(tree_store_t* store, line_arena_t* arena, size_t initial_size);
+
+/**
+ * Returns the number of rows of a version
+ * @param store tree store
+ * @param version index of the version, the current one is store->used_size
+ */
+int64_t tree_store_size(tree_store_t* store, int64_t version);
+
+/**
+ * Appends a row to the block that will be used by the next call to tree_store_change
+ * @param store tree store
+ * @param text_line row to append
+ */
+void tree_store_push_line(tree_store_t* store, line_id_t text_line);
+
+/**
+ * Creates a new version in which rows from start to end are replaced (or added) with the rows pushed with
+ * tree_store_push_line. Only O(log n) nodes of the previous version are copied
+ * @param store tree store
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void tree_store_change(tree_store_t* store, int64_t start, int64_t end);
+
+/**
+ * Creates a new version in which rows from start to end are deleted. Out of range commands create a version
+ * sharing the root of the previous one
+ * @param store tree store
+ * @param start starting index of the command
+ * @param end ending index of the command
+ */
+void tree_store_delete(tree_store_t* store, int64_t start, int64_t end);
+
+/**
+ * Reads the rows of a version from start to end; both must be valid rows. Versions are never modified, so any
+ * stored version can be read without moving the current one
+ * @param store tree store
+ * @param version index of the version, the current one is store->used_size
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param views end - start + 1 views filled with the rows, the text is not copied
+ */
+void tree_store_read(tree_store_t* store, int64_t version, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Reads the rows of the version with a given root, see tree_store_read. Only the nodes of that version are touched,
+ * so it can run on a reader thread while new versions are added
+ * @param store tree store
+ * @param root root of the version (store->versions[version])
+ * @param start starting index of the command
+ * @param end ending index of the command
+ * @param views end - start + 1 views filled with the rows, the text is not copied
+ */
+void tree_store_read_root(tree_store_t* store, tree_node_t* root, int64_t start, int64_t end, line_view_t* views);
+
+/**
+ * Keeps only the versions from first to last, renumbered from 1 on: the nodes they reach are copied in new pools,
+ * once even if shared, and the old pools are freed with the nodes of the dropped versions
+ * @param store tree store, its current version must be between first and last and no row can be pending
+ * @param first first version to keep, at least 1 (version 0 is the initial state, it is always kept)
+ * @param last last version to keep
+ */
+void tree_store_compact(tree_store_t* store, int64_t first, int64_t last);
+
+/**
+ * Calls visit on every row id stored in the nodes
+ * @param store tree store
+ * @param visit function called with a pointer to the id, it can change it
+ * @param context passed to visit
+ */
+void tree_store_for_each_line(tree_store_t* store, line_visit_t visit, void* context);
+
+/**
+ * Frees every node and version of the store
+ * @param store store to free
+ */
+void free_tree_store(tree_store_t* store);
+
+#endif //API_PROJECT_MEMENTOPATTERN_PERSISTENT_TREE_H
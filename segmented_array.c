@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "segmented_array.h"
+#include "instrumentation.h"
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+/**
+ * Makes room for one more segment in the directory
+ * @param a array
+ */
+static void segmented_directory_reserve(segmented_array_t* a)
+{
+    if (a->segment_count == a->directory_size){ //only the directory is copied, never the elements
+        segmented_directory_t* retired = malloc(sizeof(segmented_directory_t));
+        char** segments = malloc(2 * a->directory_size * sizeof(char*));
+        memcpy(segments, a->segments, a->directory_size * sizeof(char*));
+        retired->segments = a->segments; // a reader may still be indexing the old directory, it is freed with the array
+        retired->previous = a->retired;
+        a->retired = retired;
+        a->directory_size *= 2;
+        __atomic_store_n(&a->segments, segments, __ATOMIC_RELEASE);
+        INSTR_ADD(realloc_events, 1);
+        INSTR_ADD(bytes_allocated, a->directory_size * sizeof(char*));
+    }
+}
+
+/**
+ * Gives back the memory of a segment that is not borrowed
+ * @param a array
+ * @param index index of the segment
+ */
+static void segmented_release(segmented_array_t* a, size_t index)
+{
+    if (index < a->borrowed_count + a->spilled_count){ //mapped from the backing file, its offset is kept to be reused
+        munmap(a->segments[index], SEGMENT_SIZE * a->element_size);
+        a->spilled_count = index - a->borrowed_count;
+    } else
+        free(a->segments[index]);
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+void init_segmented_array(segmented_array_t* a, size_t element_size)
+{
+    a->segments = malloc(SEGMENT_DIRECTORY_INITIAL_SIZE * sizeof(char*));
+    a->segment_count = 0;
+    a->directory_size = SEGMENT_DIRECTORY_INITIAL_SIZE;
+    a->element_size = element_size;
+    a->max_size = 0;
+    a->retired = NULL;
+    a->borrowed_count = 0;
+    a->spilled_count = 0;
+    a->spill_offsets = NULL;
+    a->spill_offsets_size = 0;
+}
+
+void segmented_array_grow(segmented_array_t* a)
+{
+    segmented_directory_reserve(a);
+    a->segments[a->segment_count] = malloc(SEGMENT_SIZE * a->element_size);
+    INSTR_ADD(bytes_allocated, SEGMENT_SIZE * a->element_size);
+    a->segment_count++;
+    a->max_size = a->max_size + SEGMENT_SIZE;
+}
+
+void segmented_array_borrow(segmented_array_t* a, char* memory, size_t segment_count)
+{
+    for (size_t i = 0; i < segment_count; i++){
+        segmented_directory_reserve(a);
+        a->segments[a->segment_count] = memory + i * SEGMENT_SIZE * a->element_size;
+        a->segment_count++;
+        a->max_size = a->max_size + SEGMENT_SIZE;
+    }
+    a->borrowed_count = segment_count;
+}
+
+int segmented_array_spill(segmented_array_t* a, int fd, off_t offset)
+{
+    size_t index = a->borrowed_count + a->spilled_count;
+    size_t size = SEGMENT_SIZE * a->element_size;
+    size_t written = 0;
+
+    while (written < size){
+        ssize_t bytes = pwrite(fd, a->segments[index] + written, size - written, offset + (off_t)written);
+        if (bytes <= 0)
+            return -1;
+        written = written + bytes;
+    }
+    char* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset); //a later write to the segment goes to the file
+    if (mapped == MAP_FAILED)
+        return -1;
+    free(a->segments[index]);
+    a->segments[index] = mapped;
+    if (a->spilled_count == a->spill_offsets_size){ //not a released offset: a new one. Spills are rare next to the write
+        a->spill_offsets = realloc(a->spill_offsets, (a->spill_offsets_size + 1) * sizeof(off_t));
+        a->spill_offsets_size++;
+    }
+    a->spill_offsets[a->spilled_count] = offset;
+    a->spilled_count++;
+    return 0;
+}
+
+void segmented_array_shrink(segmented_array_t* a, size_t size)
+{
+    size_t needed = (size + SEGMENT_SIZE - 1) >> SEGMENT_SHIFT;
+    while (a->segment_count > needed && a->segment_count > a->borrowed_count){
+        a->segment_count--;
+        segmented_release(a, a->segment_count);
+        a->max_size = a->max_size - SEGMENT_SIZE;
+    }
+}
+
+void free_segmented_array(segmented_array_t* a)
+{
+    while (a->segment_count > a->borrowed_count){
+        a->segment_count--;
+        segmented_release(a, a->segment_count);
+    }
+    free(a->segments);
+    while (a->retired != NULL){
+        segmented_directory_t* previous = a->retired->previous;
+        free(a->retired->segments);
+        free(a->retired);
+        a->retired = previous;
+    }
+    a->segments = NULL;
+    a->segment_count = 0;
+    a->max_size = 0;
+    a->borrowed_count = 0;
+    a->spilled_count = 0;
+    free(a->spill_offsets);
+    a->spill_offsets = NULL;
+    a->spill_offsets_size = 0;
+}
@@ -0,0 +1,116 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_SEGMENTED_ARRAY_H
+#define API_PROJECT_MEMENTOPATTERN_SEGMENTED_ARRAY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define SEGMENT_SHIFT 12
+#define SEGMENT_SIZE (1 << SEGMENT_SHIFT) // elements per segment
+#define SEGMENT_MASK (SEGMENT_SIZE - 1)
+#define SEGMENT_DIRECTORY_INITIAL_SIZE 64
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Array made of fixed size segments plus a directory pointing to them. Growing adds a segment and at most
+ * reallocates the directory: elements already stored never move, so there is no full copy as with realloc.
+ * A directory that is replaced is kept until the array is freed and the new one is published with a release store,
+ * so a reader on another thread can index elements that were published to it while the array keeps growing.
+ */
+typedef struct segmented_directory_s{
+    char** segments;
+    struct segmented_directory_s* previous;
+} segmented_directory_t;
+
+typedef struct segmented_array_s{
+    char** segments;
+    size_t segment_count;
+    size_t directory_size;
+    size_t element_size;
+    size_t max_size; // number of elements that can be stored without growing
+    segmented_directory_t* retired; // directories replaced by a bigger one, still used by concurrent readers
+    size_t borrowed_count; // the first segments point into memory owned by someone else (a mapped file), never freed
+    size_t spilled_count;  // segments after the borrowed ones moved to a backing file and mapped from it
+    off_t* spill_offsets;  // position in the file of every spilled segment, followed by the ones released by shrink
+    size_t spill_offsets_size;
+} segmented_array_t;
+
+/**
+ * Initializes an empty segmented array, no segment is allocated yet
+ * @param a array to initialize
+ * @param element_size size of an element in bytes
+ */
+void init_segmented_array(segmented_array_t* a, size_t element_size);
+
+/**
+ * Adds a segment at the end of the array, max_size grows by SEGMENT_SIZE
+ * @param a array to grow
+ */
+void segmented_array_grow(segmented_array_t* a);
+
+/**
+ * Adds segments that point into memory owned by the caller instead of allocating them, e.g. a mapped file
+ * @param a array to which the segments are added, it must be empty
+ * @param memory segment_count * SEGMENT_SIZE elements, it must outlive the array
+ * @param segment_count number of segments
+ */
+void segmented_array_borrow(segmented_array_t* a, char* memory, size_t segment_count);
+
+/**
+ * Moves the first segment that is neither borrowed nor spilled to a backing file: it is written at offset and mapped
+ * back in its place, so the kernel reads it again only when it is touched and can reclaim its memory meanwhile
+ * @param a array, it can't have concurrent readers and must have a segment to spill
+ * @param fd backing file, open for reading and writing, always the same for an array
+ * @param offset position in the file, a multiple of the page size: segmented_array_released_offset if there is one
+ * @return 0, -1 if the segment could not be written or mapped (it stays in memory)
+ */
+int segmented_array_spill(segmented_array_t* a, int fd, off_t offset);
+
+/**
+ * Returns the position in the backing file of a spilled segment that shrink released, to be given to the next
+ * segmented_array_spill so the file does not grow
+ * @param a array
+ * @return the position, -1 if no spilled segment was released
+ */
+static inline off_t segmented_array_released_offset(const segmented_array_t* a)
+{
+    return a->spilled_count < a->spill_offsets_size ? a->spill_offsets[a->spilled_count] : -1;
+}
+
+/**
+ * Returns the bytes of the segments allocated on the heap, the borrowed and spilled ones are not counted
+ * @param a array
+ */
+static inline size_t segmented_array_heap_size(const segmented_array_t* a)
+{
+    return (a->segment_count - a->borrowed_count - a->spilled_count) * SEGMENT_SIZE * a->element_size;
+}
+
+/**
+ * Frees (or unmaps) the segments at the end of the array that are not needed to store size elements, borrowed ones
+ * are kept
+ * @param a array to shrink, it can't have concurrent readers
+ * @param size number of elements that must still fit
+ */
+void segmented_array_shrink(segmented_array_t* a, size_t size);
+
+/**
+ * Frees every segment and the directory
+ * @param a array to free
+ */
+void free_segmented_array(segmented_array_t* a);
+
+/**
+ * Returns the address of an element, index must be lower than max_size. Safe to call from a reader thread while
+ * another thread grows the array, as long as the element was published to the reader
+ * @param a array
+ * @param index index of the element
+ */
+static inline void* segmented_array_at(segmented_array_t* a, size_t index)
+{
+    char** segments = __atomic_load_n(&a->segments, __ATOMIC_ACQUIRE); // a plain load on x86
+    return segments[index >> SEGMENT_SHIFT] + (index & SEGMENT_MASK) * a->element_size;
+}
+
+#endif //API_PROJECT_MEMENTOPATTERN_SEGMENTED_ARRAY_H
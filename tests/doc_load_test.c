@@ -0,0 +1,143 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "document.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+// positions of the fields of the header written by doc_save (doc_file_header_t): an 8 byte magic, then int64_t fields
+#define HEADER_SLICE_COUNT 8
+#define HEADER_CURRENT_VERSION 16
+#define HEADER_UNDO_FLOOR 24
+#define HEADER_TEXT_USED_SIZE 40
+#define HEADER_CELL_COUNT 56
+#define HEADER_LINE_COUNT 64
+#define HEADER_SLICES_OFFSET 80
+#define HEADER_CELLS_OFFSET 88
+#define HEADER_LINES_OFFSET 96
+#define TEST_ROWS 100
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * A saved document is copied and changed in one field of its header, or truncated: doc_load has to refuse every copy
+ * with EINVAL before it uses anything in the file, and still load the original.
+ */
+typedef struct test_case_s{
+    const char* name;
+    int64_t field;    // position of the field changed, -1 to truncate the file instead
+    int64_t value;    // new value of the field, or size of the truncated file
+} test_case_t;
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static int64_t read_field(const char* path, int64_t field)
+{
+    int64_t value = 0;
+    int fd = open(path, O_RDONLY);
+    if (pread(fd, &value, sizeof(value), field) != sizeof(value))
+        value = -1;
+    close(fd);
+    return value;
+}
+
+static void copy_file(const char* from, const char* to)
+{
+    char buffer[4096];
+    ssize_t bytes;
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    while ((bytes = read(in, buffer, sizeof(buffer))) > 0)
+        if (write(out, buffer, bytes) != bytes)
+            break;
+    close(in);
+    close(out);
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+int main(void)
+{
+    char saved[] = "/tmp/memento-load-test-XXXXXX";
+    char tampered[sizeof(saved) + 4];
+    line_view_t rows[TEST_ROWS];
+    char texts[TEST_ROWS][16];
+    document_t* doc;
+    int failed = 0;
+    int i, fd;
+
+    fd = mkstemp(saved);
+    if (fd < 0){
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    strcpy(tampered, saved);
+    strcat(tampered, ".bad");
+
+    doc = doc_create(NULL);
+    for (i = 0; i < TEST_ROWS; i++){
+        sprintf(texts[i], "row %d\n", i);
+        rows[i].text = texts[i];
+        rows[i].length = strlen(texts[i]);
+    }
+    doc_change(doc, 1, TEST_ROWS, rows);
+    doc_delete(doc, 1, 10);
+    doc_undo(doc, 1);
+    if (doc_save(doc, saved) != 0){
+        perror(saved);
+        return 1;
+    }
+    doc_destroy(doc);
+
+    int64_t lines_offset = read_field(saved, HEADER_LINES_OFFSET);
+    int64_t cell_count = read_field(saved, HEADER_CELL_COUNT);
+    test_case_t cases[] = {
+        {"truncated in the header", -1, 40},
+        {"truncated in the rows", -1, lines_offset + 8},
+        {"current version after the last one", HEADER_CURRENT_VERSION, 1000000},
+        {"negative current version", HEADER_CURRENT_VERSION, -1},
+        {"undo floor after the current version", HEADER_UNDO_FLOOR, 2},
+        {"no versions", HEADER_SLICE_COUNT, 0},
+        {"more rows than the file holds", HEADER_LINE_COUNT, 10000000},
+        {"no rows", HEADER_LINE_COUNT, 0},
+        {"more cells than the file holds", HEADER_CELL_COUNT, 1 << 30},
+        {"text used after the cells", HEADER_TEXT_USED_SIZE, cell_count + 1},
+        {"sections out of order", HEADER_CELLS_OFFSET, read_field(saved, HEADER_SLICES_OFFSET)},
+        {"offset not aligned", HEADER_LINES_OFFSET, lines_offset + 8},
+        {"offset past the end of the file", HEADER_LINES_OFFSET, (int64_t)1 << 40},
+    };
+
+    for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++){
+        copy_file(saved, tampered);
+        if (cases[i].field < 0)
+            failed = truncate(tampered, cases[i].value) != 0 || failed;
+        else {
+            fd = open(tampered, O_WRONLY);
+            failed = pwrite(fd, &cases[i].value, sizeof(cases[i].value), cases[i].field) != sizeof(cases[i].value) || failed;
+            close(fd);
+        }
+        errno = 0;
+        doc = doc_load(tampered, NULL);
+        if (doc != NULL || errno != EINVAL){
+            printf("%s: not refused with EINVAL\n", cases[i].name);
+            failed = 1;
+            if (doc != NULL)
+                doc_destroy(doc);
+        }
+    }
+
+    doc = doc_load(saved, NULL);
+    if (doc == NULL || doc_current_version(doc) != 1 || doc_size(doc) != TEST_ROWS){
+        printf("the saved document does not load\n");
+        failed = 1;
+    }
+    if (doc != NULL)
+        doc_destroy(doc);
+    unlink(saved);
+    unlink(tampered);
+    printf("%d tampered files, %s\n", (int)(sizeof(cases) / sizeof(cases[0])), failed ? "failed" : "ok");
+    return failed;
+}
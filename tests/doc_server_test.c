@@ -0,0 +1,197 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "doc_server.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define TEST_READERS 4
+#define TEST_COMMANDS 20000
+#define TEST_TEXTS 64
+#define TEST_MAX_ROWS 8
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * One writer session gets changes, deletes, undo and redo while the reader threads take snapshots, read them twice
+ * and release them. A document without the server gets the same commands, the last snapshot must match it.
+ */
+typedef struct test_reader_s{
+    pthread_t thread;
+    document_t* doc;
+    const doc_snapshot_t* seen[TEST_READERS + 3]; // distinct snapshots returned, one more than the bound
+    int seen_size;
+    long reads;
+    const char* error;
+} test_reader_t;
+
+static int done;
+static char texts[TEST_TEXTS][16];
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static int same_rows(const line_view_t* a, const line_view_t* b, int64_t size)
+{
+    for (int64_t i = 0; i < size; i++)
+        if (a[i].length != b[i].length || memcmp(a[i].text, b[i].text, a[i].length) != 0)
+            return 0;
+    return 1;
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+static void* test_read(void* argument)
+{
+    test_reader_t* reader = argument;
+    line_view_t* first = NULL;
+    line_view_t* second = NULL;
+    int64_t rows_size = 0;
+    int i;
+
+    while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE) && reader->error == NULL){
+        const doc_snapshot_t* snapshot = doc_snapshot(reader->doc);
+        int64_t version = doc_snapshot_version(snapshot);
+        int64_t size = doc_snapshot_size(snapshot);
+        if (size + 1 > rows_size){
+            rows_size = 2 * (size + 1);
+            first = realloc(first, rows_size * sizeof(line_view_t));
+            second = realloc(second, rows_size * sizeof(line_view_t));
+        }
+        if (doc_snapshot_read(reader->doc, snapshot, 1, size, first) != size)
+            reader->error = "a snapshot has fewer rows than its size";
+        for (i = 0; i < size && reader->error == NULL; i++)
+            if (first[i].length < 2 || first[i].text[first[i].length - 1] != '\n')
+                reader->error = "torn row";
+        doc_snapshot_read(reader->doc, snapshot, 1, size, second);
+        if (doc_snapshot_version(snapshot) != version || doc_snapshot_size(snapshot) != size || !same_rows(first, second, size))
+            reader->error = "a snapshot changed while it was held";
+
+        for (i = 0; i < reader->seen_size && reader->seen[i] != snapshot; i++)
+            ;
+        if (i == reader->seen_size){
+            if (reader->seen_size == TEST_READERS + 3)
+                reader->error = "released snapshots are not reused";
+            else
+                reader->seen[reader->seen_size++] = snapshot;
+        }
+        doc_snapshot_release(snapshot);
+        reader->reads++;
+    }
+    free(first);
+    free(second);
+    return NULL;
+}
+
+/**
+ * Runs the test on a version store
+ * @param version_store DOC_ARRAY_STORE or DOC_TREE_STORE
+ * @return 0 if it passed, 1 otherwise
+ */
+static int test_store(int version_store)
+{
+    doc_options_t options;
+    test_reader_t readers[TEST_READERS];
+    line_view_t lines[TEST_MAX_ROWS];
+    const doc_snapshot_t* seen[TEST_READERS * (TEST_READERS + 3)];
+    int seen_size = 0;
+    long reads = 0;
+    unsigned int random = 12345;
+    const char* error = NULL;
+    int i, j, k;
+
+    doc_default_options(&options);
+    options.version_store = version_store;
+    options.borrow_lines = 1; // the texts outlive the documents
+    doc_server_t* server = doc_server_create(2);
+    doc_session_t* session = doc_session_open(server, &options);
+    document_t* mirror = doc_create(&options);
+
+    done = 0;
+    for (i = 0; i < TEST_READERS; i++){
+        readers[i].doc = doc_session_document(session);
+        readers[i].seen_size = 0;
+        readers[i].reads = 0;
+        readers[i].error = NULL;
+        pthread_create(&readers[i].thread, NULL, test_read, &readers[i]);
+    }
+
+    for (i = 0; i < TEST_COMMANDS; i++){
+        random = random * 1103515245 + 12345;
+        int64_t size = doc_size(mirror);
+        int command = (random >> 16) % 10;
+        if (command < 5){ //a change from 1 to size + 1
+            int64_t start = 1 + (random >> 4) % (size + 1);
+            int64_t count = 1 + (random >> 20) % TEST_MAX_ROWS;
+            for (j = 0; j < count; j++){
+                lines[j].text = texts[(random >> (j + 3)) % TEST_TEXTS];
+                lines[j].length = strlen(lines[j].text);
+            }
+            doc_session_change(session, start, start + count - 1, lines);
+            doc_change(mirror, start, start + count - 1, lines);
+        } else if (command < 7){
+            int64_t start = 1 + (random >> 5) % (size + 2);
+            doc_session_delete(session, start, start + (random >> 12) % 3);
+            doc_delete(mirror, start, start + (random >> 12) % 3);
+        } else if (command < 9){
+            doc_session_undo(session, 1 + (random >> 9) % 3);
+            doc_undo(mirror, 1 + (random >> 9) % 3);
+        } else {
+            doc_session_redo(session, 1 + (random >> 9) % 3);
+            doc_redo(mirror, 1 + (random >> 9) % 3);
+        }
+        if (i % 256 == 0) //the readers see the versions go by instead of the last one only
+            doc_server_wait(server);
+    }
+    doc_server_wait(server);
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+    for (i = 0; i < TEST_READERS; i++){
+        pthread_join(readers[i].thread, NULL);
+        reads = reads + readers[i].reads;
+        if (readers[i].error != NULL)
+            error = readers[i].error;
+        for (j = 0; j < readers[i].seen_size; j++){ //every reader holds one at a time: the writer needs two more at most
+            for (k = 0; k < seen_size && seen[k] != readers[i].seen[j]; k++)
+                ;
+            if (k == seen_size)
+                seen[seen_size++] = readers[i].seen[j];
+        }
+    }
+    if (error == NULL && seen_size > TEST_READERS + 2)
+        error = "released snapshots are not reused";
+
+    document_t* doc = doc_session_document(session);
+    const doc_snapshot_t* snapshot = doc_snapshot(doc);
+    int64_t size = doc_size(mirror);
+    if (error == NULL && (doc_snapshot_version(snapshot) != doc_current_version(mirror) || doc_snapshot_size(snapshot) != size))
+        error = "the last snapshot is not the current version";
+    if (error == NULL){
+        line_view_t* expected = malloc((size + 1) * sizeof(line_view_t));
+        line_view_t* found = malloc((size + 1) * sizeof(line_view_t));
+        doc_read_range(mirror, 1, size, expected);
+        doc_snapshot_read(doc, snapshot, 1, size, found);
+        if (!same_rows(expected, found, size))
+            error = "the last snapshot has different rows";
+        free(expected);
+        free(found);
+    }
+    doc_snapshot_release(snapshot);
+
+    printf("%s store: %ld reads of %d snapshots, %s\n", version_store == DOC_TREE_STORE ? "tree" : "array", reads, seen_size,
+           error == NULL ? "ok" : error);
+    doc_destroy(mirror);
+    doc_session_close(session);
+    doc_server_destroy(server);
+    return error != NULL;
+}
+
+int main(void)
+{
+    int failed;
+
+    for (int i = 0; i < TEST_TEXTS; i++)
+        sprintf(texts[i], "row %d\n", i);
+    failed = test_store(DOC_ARRAY_STORE);
+    failed = test_store(DOC_TREE_STORE) || failed;
+    return failed;
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <strings.h>
+#include "trace_generator.h"
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define TRACE_MAX_ROW_PADDING 64
+
+const trace_profile_t trace_profiles[TRACE_PROFILE_COUNT] = {
+    // name               c   d   p   u   r  append  change  delete  print  jump
+    {"WriteOnly",        80,  0, 20,  0,  0,    5,     100,      0,   100,    0},
+    {"BulkReads",        10,  0, 90,  0,  0,   20,     100,      0,     0,    0},
+    {"TimeForAChange",   60, 15, 25,  0,  0,   10,     100,     50,   100,    0},
+    {"AlteringHistory",  45, 10, 25, 20,  0,   30,     100,     50,   100,   10},
+    {"RollingBack",      35, 15, 20, 15, 15,   30,     100,     50,   100,   10},
+    {"RollerCoaster",    25, 10, 25, 20, 20,   30,     100,     50,   100,  200},
+    {"Laude",            30, 15, 25, 15, 15,   30,     200,    100,   500,   50},
+};
+
+/* ------------------------------------------------------------------------------------------ basic functions ------------------------------------------------------------------------------------------ */
+
+static inline uint64_t trace_random(uint64_t* state) //xorshift64*
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Returns a number from 1 to max (1 if max is not positive)
+ */
+static inline int64_t trace_between_1_and(uint64_t* state, int64_t max)
+{
+    if (max <= 1)
+        return 1;
+    return 1 + (int64_t)(trace_random(state) % (uint64_t)max);
+}
+
+/* ------------------------------------------------------------------------------------------ functions ------------------------------------------------------------------------------------------ */
+
+const trace_profile_t* trace_profile(const char* name)
+{
+    for (int i = 0; i < TRACE_PROFILE_COUNT; i++)
+        if (strcasecmp(trace_profiles[i].name, name) == 0)
+            return &trace_profiles[i];
+    return NULL;
+}
+
+void trace_generate(FILE* output, const trace_profile_t* profile, int64_t commands, uint64_t seed)
+{
+    static const char padding[TRACE_MAX_ROW_PADDING + 1] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+    int total_weight = profile->change_weight + profile->delete_weight + profile->print_weight + profile->undo_weight + profile->redo_weight;
+    uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1; // never 0, which xorshift would keep
+    int64_t* sizes = malloc(sizeof(int64_t) * (commands + 1)); // rows of every version
+    int64_t current = 0, latest = 0;
+    int64_t start, end, i;
+
+    sizes[0] = 0;
+    for (int64_t command = 0; command < commands; command++){
+        int64_t size = sizes[current];
+        int choice = (int)(trace_random(&state) % (uint64_t)total_weight);
+
+        if ((choice = choice - profile->change_weight) < 0){
+            if (size == 0 || (int)(trace_random(&state) % 100) < profile->append_percent)
+                start = size + 1;
+            else
+                start = trace_between_1_and(&state, size);
+            end = start + trace_between_1_and(&state, profile->max_change_rows) - 1;
+            fprintf(output, "%lld,%lldc\n", (long long)start, (long long)end);
+            for (i = start; i <= end; i++){
+                int length = (int)(trace_random(&state) % TRACE_MAX_ROW_PADDING);
+                fprintf(output, "row %lld of version %lld %.*s\n", (long long)i, (long long)(current + 1), length, padding);
+            }
+            fputs(".\n", output);
+            size = end > size ? end : size;
+        } else if ((choice = choice - profile->delete_weight) < 0){
+            start = trace_between_1_and(&state, size);
+            end = start + trace_between_1_and(&state, profile->max_delete_rows) - 1;
+            fprintf(output, "%lld,%lldd\n", (long long)start, (long long)end);
+            if (start <= size) //rows that do not exist are ignored
+                size = size - ((end < size ? end : size) - start + 1);
+        } else if ((choice = choice - profile->print_weight) < 0){
+            start = profile->max_print_rows == 0 ? 1 : trace_between_1_and(&state, size);
+            end = profile->max_print_rows == 0 ? (size > 0 ? size : 1) : start + trace_between_1_and(&state, profile->max_print_rows) - 1;
+            fprintf(output, "%lld,%lldp\n", (long long)start, (long long)end);
+            continue;
+        } else if ((choice = choice - profile->undo_weight) < 0){
+            int64_t count = trace_between_1_and(&state, profile->max_jump);
+            fprintf(output, "%lldu\n", (long long)count);
+            current = count > current ? 0 : current - count;
+            continue;
+        } else {
+            int64_t count = trace_between_1_and(&state, profile->max_jump);
+            fprintf(output, "%lldr\n", (long long)count);
+            current = count > latest - current ? latest : current + count;
+            continue;
+        }
+
+        current++; //a change or a delete drops the redo stack
+        latest = current;
+        sizes[current] = size;
+    }
+    fputs("q\n", output);
+    free(sizes);
+}
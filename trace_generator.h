@@ -0,0 +1,50 @@
+#ifndef API_PROJECT_MEMENTOPATTERN_TRACE_GENERATOR_H
+#define API_PROJECT_MEMENTOPATTERN_TRACE_GENERATOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* ------------------------------------------------------------------------------------------ constants ------------------------------------------------------------------------------------------ */
+#define TRACE_PROFILE_COUNT 7
+
+/* ------------------------------------------------------------------------------------------ prototypes ------------------------------------------------------------------------------------------ */
+
+/*
+ * Command mix of a workload class of the public tests: the weights of the commands (out of their sum), how many rows
+ * a command touches and how far an undo/redo jumps. The generator follows the size of every version, so the
+ * addresses it writes are always valid for the version they apply to.
+ */
+typedef struct trace_profile_s{
+    const char* name;
+    int change_weight;
+    int delete_weight;
+    int print_weight;
+    int undo_weight;
+    int redo_weight;
+    int append_percent;       // changes that add rows after the last one, the others replace rows inside the document
+    int64_t max_change_rows;
+    int64_t max_delete_rows;
+    int64_t max_print_rows;   // 0 to print the whole document every time
+    int64_t max_jump;         // commands undone/redone at once
+} trace_profile_t;
+
+extern const trace_profile_t trace_profiles[TRACE_PROFILE_COUNT];
+
+/**
+ * Looks for a workload class by name (case insensitive), e.g. "WriteOnly" or "RollerCoaster"
+ * @param name name of the class
+ * @return the profile, NULL if there is no class with that name
+ */
+const trace_profile_t* trace_profile(const char* name);
+
+/**
+ * Writes a command stream in the format of the editor input, ending with "q". The same profile, count and seed
+ * always give the same stream
+ * @param output file the commands are written to
+ * @param profile command mix
+ * @param commands number of commands, "q" excluded
+ * @param seed seed of the random choices
+ */
+void trace_generate(FILE* output, const trace_profile_t* profile, int64_t commands, uint64_t seed);
+
+#endif //API_PROJECT_MEMENTOPATTERN_TRACE_GENERATOR_H